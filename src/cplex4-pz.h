@@ -8,6 +8,15 @@
 
 */
 
+#include "cplex_candidates.h"
+#include "cplex_flow.h"
+#include "cplex_network.h"
+#include "cplex_solution.h"
+#include "cplex_symmetry.h"
+#include "cplex_telemetry.h"
+#include "cplex_threads.h"
+#include "cplex_vnf_search.h"
+#include "cplex_warm_start.h"
 #include "datastructure.h"
 #include "util.h"
 #include <string>
@@ -22,7 +31,6 @@ ILOSTLBEGIN
 typedef IloArray<IloIntVarArray> IloIntVar2dArray;
 typedef IloArray<IloIntVar2dArray> IloIntVar3dArray;
 typedef IloArray<IloIntVar3dArray> IloIntVar4dArray;
-typedef IloArray<IloIntVar4dArray> IloIntVar5dArray;
 
 typedef IloArray<IloIntArray> IloInt2dArray;
 typedef IloArray<IloInt2dArray> IloInt3dArray;
@@ -61,7 +69,9 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
                    std::vector<std::vector<std::pair<int, int>>> &path,
                    std::vector<std::vector<std::pair<int, int>>> &all_edges,
                    int *delays, std::vector<int> &utilization,
-                   string topology_filename, int max_vnf, int &is_feasible);
+                   string topology_filename, int max_vnf, int &is_feasible,
+                   const std::vector<std::vector<int>> &warm_start,
+                   bool feasibility_only);
 
 void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
                std::vector<double> &opex_breakdown, double &running_time,
@@ -81,19 +91,52 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
 
   int is_feasible = 0;  // 0 = Infeasible, 1 = feasible
 
-  while (max_vnf != last_max_vnf) {
-    // cout << "Run Max VNF = " << max_vnf << endl;
-    last_max_vnf = max_vnf;
+  std::vector<std::vector<int>> warm_start;
+  if (use_cplex_warm_start) {
+    warm_start = ComputeViterbiPlacement(traffic_requests);
+  }
+
+  if (max_vnf_search == "parallel") {
+    // probe for feasibility only, in parallel, then solve the final bound.
+    // The probes stop at their first incumbent, so unlike the bisection
+    // below, which keeps the output of its last run, the output always comes
+    // from this extra full solve. Both end at the same max_vnf, as the last
+    // run of the bisection is always at its final upper bound.
+    max_vnf = SearchMaxVnf(lower_bound, upper_bound, [&](int probe_max_vnf) {
+      const int kTrafficCount = traffic_requests.size();
+      double probe_opex, probe_running_time;
+      std::vector<double> probe_opex_breakdown;
+      std::vector<std::vector<int>> probe_sequence(kTrafficCount);
+      std::vector<std::vector<std::pair<int, int>>> probe_path(kTrafficCount),
+          probe_all_edges(kTrafficCount);
+      std::vector<int> probe_delays(kTrafficCount), probe_utilization;
+      int probe_feasible = 0;
+      run_cplex_opt(traffic_requests, probe_opex, probe_opex_breakdown,
+                    probe_running_time, probe_sequence.data(), probe_path,
+                    probe_all_edges, probe_delays.data(), probe_utilization,
+                    topology_filename, probe_max_vnf, probe_feasible,
+                    warm_start, true);
+      return probe_feasible == 1;
+    });
     run_cplex_opt(traffic_requests, opex, opex_breakdown, running_time,
                   sequence, path, all_edges, delays, utilization,
-                  topology_filename, max_vnf, is_feasible);
-    if (is_feasible) {
-      // cout << "Soultion found" << endl;
-      upper_bound = max_vnf;
-    } else {
-      lower_bound = max_vnf;
-    }
-    max_vnf = ceil((lower_bound + upper_bound) / 2.0);
+                  topology_filename, max_vnf, is_feasible, warm_start, false);
+  } else {
+    while (max_vnf != last_max_vnf) {
+      // cout << "Run Max VNF = " << max_vnf << endl;
+      last_max_vnf = max_vnf;
+      run_cplex_opt(traffic_requests, opex, opex_breakdown, running_time,
+                    sequence, path, all_edges, delays, utilization,
+                    topology_filename, max_vnf, is_feasible, warm_start,
+                    false);
+      if (is_feasible) {
+        // cout << "Soultion found" << endl;
+        upper_bound = max_vnf;
+      } else {
+        lower_bound = max_vnf;
+      }
+      max_vnf = ceil((lower_bound + upper_bound) / 2.0);
+    }
   }
 
   auto solution_end_time = std::chrono::high_resolution_clock::now();
@@ -112,12 +155,20 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
                    std::vector<std::vector<std::pair<int, int>>> &path,
                    std::vector<std::vector<std::pair<int, int>>> &all_edges,
                    int *delays, std::vector<int> &utilization,
-                   string topology_filename, int max_vnf, int &is_feasible) {
+                   string topology_filename, int max_vnf, int &is_feasible,
+                   const std::vector<std::vector<int>> &warm_start,
+                   bool feasibility_only) {
   IloEnv env;
   try {
+    CplexTelemetry telemetry(
+        traffic_requests,
+        std::string(feasibility_only ? "probe:" : "max_vnf:") +
+            std::to_string(max_vnf));
     // declare the model and the solver
     IloModel model(env);
     IloCplex cplex(model);
+    // couple the variables with linear inequalities instead of IloIfThen
+    const bool kLinearFormulation = cplex_formulation == "linear";
     cplex.setParam(IloCplex::DataCheck, 1);
 
     // save all the constraints for model checking
@@ -133,11 +184,12 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     int kSwitchCount = 0, kInitialSwitchCount = 0, kLinkCount = 0,
         kServerCount = 0, kResourceCount = 0;
 
-    // read topology file and populate associated variables
-    FILE *topology_file = fopen(topology_filename.c_str(), "r");
+    // the physical network is built once and shared by all calls
+    const physical_network &network = GetPhysicalNetwork();
 
-    // read switch and link count
-    fscanf(topology_file, "%d %d", &kSwitchCount, &kLinkCount);
+    // switch and link count
+    kSwitchCount = network.switch_count;
+    kLinkCount = network.links.size();
     kInitialSwitchCount = kSwitchCount;
     // ingress and egress middleboxes are deployed on special non-existent
     // servers
@@ -169,14 +221,14 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     */
 
     // Declare the required DSs
-    std::vector<int> _nbr[kSwitchCount];
+    const std::vector<int> *_nbr = network.nbr.data();
     int switch4server[kServerCount];
     std::vector<int> server4switch[kSwitchCount];
     int actual_server[kServerCount];
-    int _beta[kSwitchCount][kSwitchCount];
-    int _delta[kSwitchCount][kSwitchCount];
-    int max_beta = 0;
-    int max_delta = 0;
+    const matrix<long> &_beta = network.beta;
+    const matrix<int> &_delta = network.delta;
+    int max_beta = network.max_beta;
+    int max_delta = network.max_delta;
 
     //////////CPLEX Variable//////////
     //_z_s_n = 1, iff _n is attached to _s
@@ -209,9 +261,10 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     }
     */
 
-    // read the switch info from file
+    // read the switch info
     for (int i = 0, sw, cpu; i < kSwitchCount; ++i) {
-      fscanf(topology_file, "%d %d", &sw, &cpu);
+      sw = network.switches[i].first;
+      cpu = network.switches[i].second;
       _z_s_n[sw][sw] = 1;  // for the special ones
       _z_s_n[sw][sw + kSwitchCount] =
           1;  // these is where we deploy normal middleboxes
@@ -249,35 +302,6 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     // print_IloInt2dArray(c_nr, kServerCount, kResourceCount, "c_nr");
     */
 
-    // initialize _beta & _delta to remove any garbage value
-    for (int _u = 0; _u < kSwitchCount; ++_u) {
-      for (int _v = 0; _v < kSwitchCount; ++_v) {
-        _beta[_u][_v] = _delta[_u][_v] = 0;
-      }
-    }
-
-    // read link info from file
-    int b;
-    for (int _l = 0, _u, _v, d; _l < kLinkCount; ++_l) {
-      fscanf(topology_file, "%d %d %d %d", &_u, &_v, &b, &d);
-      _beta[_u][_v] = b;
-      _beta[_v][_u] = b;
-      _delta[_u][_v] = d;
-      _delta[_v][_u] = d;
-      //_nbr
-      _nbr[_u].push_back(_v);
-      _nbr[_v].push_back(_u);
-      // max_beta & max_delta
-      max_beta = max(max_beta, b);
-      max_delta = max(max_delta, d);
-
-      // cout << "Bandwidth " << _beta[_u][_v] << endl;
-    }
-
-    // print_IloInt2dArray(_u_s_l, kSwitchCount, kLinkCount, "_u_s_l");
-    // print_IloInt2dArray(_v_s_l, kSwitchCount, kLinkCount, "_v_s_l");
-
-    fclose(topology_file);
 
     DEBUG("Done.\n");
 
@@ -616,6 +640,25 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
       xtnm[t] = IloIntVar2dArray(env, trafficNodeCount[t]);
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
         xtnm[t][n] = IloIntVarArray(env, kMboxCount, 0, 1);
+        // the linear formulation fixes the middleboxes of another type to 0,
+        // so presolve removes them instead of branching on the type match
+        for (int m = 0; kLinearFormulation && m < kMboxCount; ++m) {
+          if (mboxType[m] != trafficNodeType[t][n]) xtnm[t][n][m].setUB(0);
+        }
+      }
+    }
+    // fix the instances a node can not or should not use to 0
+    if (cplex_pruning != "off") {
+      const std::vector<std::vector<std::vector<char> > > kCandidates =
+          ComputeCandidateInstances(traffic_requests, kMboxCount, mboxType,
+                                    server4mbox, switch4server, 1000,
+                                    cplex_pruning == "sla");
+      for (int t = 0; t < kTrafficCount; ++t) {
+        for (int n = 0; n < trafficNodeCount[t]; ++n) {
+          for (int m = 0; m < kMboxCount; ++m) {
+            if (!kCandidates[t][n][m]) xtnm[t][n][m].setUB(0);
+          }
+        }
       }
     }
     //^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
@@ -668,9 +711,28 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     //  }
     //}
 
+    //-----CPLEX Constraint------------------------------------------------
+    // ADD: symmetry breaking among the instances of a type on a server
+    if (cplex_symmetry != "off") {
+      AddInstanceSymmetryBreaking(env, model, traffic_requests, kMboxCount,
+                                  mboxType, server4mbox, ym, xtnm,
+                                  cplex_symmetry == "load");
+    }
+    //---------------------------------------------------------------------
+
     //-----CPLEX Constraint------------------------------------------------
     // ADD: constraint fot ym
     for (int m = 0; m < kMboxCount; ++m) {
+      if (kLinearFormulation) {
+        // one row per node that may use m, not one big-M row over all the
+        // nodes: it keeps ym[m] >= xtnm in the LP relaxation
+        for (int t = 0; t < kTrafficCount; ++t) {
+          for (int n = 0; n < trafficNodeCount[t]; ++n) {
+            if (xtnm[t][n][m].getUB() > 0) model.add(xtnm[t][n][m] <= ym[m]);
+          }
+        }
+        continue;
+      }
       IloIntExpr sum(env);
       for (int t = 0; t < kTrafficCount; ++t) {
         for (int n = 0; n < trafficNodeCount[t]; ++n) {
@@ -705,8 +767,12 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
 
           for (int _s = 0; _s < kSwitchCount; ++_s) {
             if (switch4mbox[m] == _s) {
-              model.add(
-                  IloIfThen(env, xtnm[t][n][m] == 1, ztn_n[t][n][_s] == 1));
+              if (kLinearFormulation) {
+                model.add(xtnm[t][n][m] <= ztn_n[t][n][_s]);
+              } else {
+                model.add(
+                    IloIfThen(env, xtnm[t][n][m] == 1, ztn_n[t][n][_s] == 1));
+              }
             }
           }
         }
@@ -750,6 +816,12 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
       u_t = traffic_requests[t].source;
       v_t = traffic_requests[t].destination;
       for (int m = 0; m < kMboxCount; ++m) {
+        if (kLinearFormulation) {
+          model.add(xtnm[t][0][m] <= ym[m] * _z_s_n[u_t][server4mbox[m]]);
+          model.add(xtnm[t][trafficNodeCount[t] - 1][m] <=
+                    ym[m] * _z_s_n[v_t][server4mbox[m]]);
+          continue;
+        }
         model.add(IloIfThen(env, xtnm[t][0][m] == 1,
                             ym[m] * _z_s_n[u_t][server4mbox[m]] == 1));
         model.add(IloIfThen(env, xtnm[t][trafficNodeCount[t] - 1][m] == 1,
@@ -761,40 +833,19 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
 
     //^^^^^CPLEX Decision Variable^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
     // wtuv_u_v = 1, if logical link (u, v) of traffic t uses physical link (_u,
-    // _v)
-    IloIntVar5dArray wtuv_u_v(env, kTrafficCount);
-    for (int t = 0; t < kTrafficCount; ++t) {
-      wtuv_u_v[t] = IloIntVar4dArray(env, trafficNodeCount[t]);
-      for (int u = 0; u < trafficNodeCount[t]; ++u) {
-        wtuv_u_v[t][u] = IloIntVar3dArray(env, trafficNodeCount[t]);
-        for (int v = 0; v < trafficNodeCount[t]; ++v) {
-          wtuv_u_v[t][u][v] = IloIntVar2dArray(env, kSwitchCount);
-          for (int _u = 0; _u < kSwitchCount; ++_u) {
-            wtuv_u_v[t][u][v][_u] = IloIntVarArray(env, kSwitchCount, 0, 1);
-          }
-        }
-      }
-    }
-    /*
-    IloIntVar5dArray wtuv_u_v(env, kTrafficCount);
-    for (int t = 0; t < kTrafficCount; ++t) {
-      wtuv_u_v[t] = IloIntVar4dArray(env, trafficNodeCount[t]);
-      for (int u = 0; u < trafficNodeCount[t]; ++u) {
-        wtuv_u_v[t][u] = IloIntVar3dArray(env, nbr[t].size());
-        for (int v : nbr[t][u]) {
-          wtuv_u_v[t][u][v] = IloIntVar2dArray(env, kSwitchCount);
-          for (int _u = 0; _u < kSwitchCount; ++_u) {
-            wtuv_u_v[t][u][v][_u] = IloIntVarArray(env, kSwitchCount, 0, 1);
-          }
-        }
-      }
-    }
-    */
+    // _v). Only chain-adjacent logical links and existing physical links
+    // have a variable.
+    FlowVariables wtuv_u_v(env, kTrafficCount, nbr, kSwitchCount, __nbr,
+                           false);
     //^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
     // cout << "w done" << endl;
 
     //-----CPLEX Constraint------------------------------------------------
     // ADD: physical link capacity constraint
+    // with --cplex_lazy_links, the rows go to the lazy constraint pool:
+    // CPLEX leaves them out of the LP relaxation and adds a row only when
+    // a candidate incumbent violates it
+    IloConstraintArray lazy_link_capacity(env);
     // cout << "kSwitchCount " << kSwitchCount << endl;
     for (int _u = 0; _u < kSwitchCount; ++_u) {
       for (int _v : __nbr[_u]) {
@@ -805,8 +856,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             for (int n1 = 0; n1 < trafficNodeCount[t]; ++n1) {
               for (int n2 : nbr[t][n1]) {
                 if (n1 < n2) {
-                  sum += (wtuv_u_v[t][n1][n2][_u][_v] +
-                          wtuv_u_v[t][n1][n2][_v][_u]) *
+                  sum += (wtuv_u_v(t, n1, n2, _u, _v) +
+                          wtuv_u_v(t, n1, n2, _v, _u)) *
                          beta_t;
                 }
               }
@@ -814,10 +865,17 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
           }
           // cout << "_u _v " << _u << " " << _v << " " << beta_u_v[_u][_v] <<
           // endl;
-          model.add(sum <= beta_u_v[_u][_v]);
+          if (use_cplex_lazy_links) {
+            lazy_link_capacity.add(sum <= beta_u_v[_u][_v]);
+          } else {
+            model.add(sum <= beta_u_v[_u][_v]);
+          }
         }
       }
     }
+    if (lazy_link_capacity.getSize() > 0) {
+      cplex.addLazyConstraints(lazy_link_capacity);
+    }
     //---------------------------------------------------------------------
     // cout << "cnst physical link" << endl;
 
@@ -831,10 +889,10 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
               IloIntExpr sum(env);
               for (int _v : __nbr[_u]) {
                 sum +=
-                    wtuv_u_v[t][n1][n2][_u][_v] - wtuv_u_v[t][n1][n2][_v][_u];
+                    wtuv_u_v(t, n1, n2, _u, _v) - wtuv_u_v(t, n1, n2, _v, _u);
                 if (_u < _v) {
-                  model.add(wtuv_u_v[t][n1][n2][_u][_v] +
-                                wtuv_u_v[t][n1][n2][_v][_u] <=
+                  model.add(wtuv_u_v(t, n1, n2, _u, _v) +
+                                wtuv_u_v(t, n1, n2, _v, _u) <=
                             1);
                 }
               }
@@ -854,7 +912,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
           IloExpr sum(env);
           for (int _u = 0; _u < kSwitchCount; ++_u) {
             for (int _v : __nbr[_u]) {
-              sum += wtuv_u_v[t][n1][n2][_u][_v];
+              sum += wtuv_u_v(t, n1, n2, _u, _v);
             }
           }
           model.add(sum > 0);
@@ -904,7 +962,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     // it also includes the middlebox type constraint
     for (int t = 0; t < kTrafficCount; ++t) {
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
-        for (int m = 0; m < kMboxCount; ++m) {
+        // enforced by the bounds of xtnm in the linear formulation
+        for (int m = 0; !kLinearFormulation && m < kMboxCount; ++m) {
           // IloExpr sum_mbox(env);
           // for (int _n = 0; _n < kServerCount; ++_n) {
           //  sum_mbox += bm_n[m][_n];
@@ -952,7 +1011,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             //link delay
             for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
-                delay += wtuv_u_v[t][n1][n2][_u][_v] * delta_u_v[_u][_v];
+                delay += wtuv_u_v(t, n1, n2, _u, _v) * delta_u_v[_u][_v];
               }
             }
           }
@@ -1028,8 +1087,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
                 for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
                   for (int _v : _nbr[_u]) {
                     if (_u < _v) {
-                      forwardingCost += 0.001 * ( wtuv_u_v[t][n1][n2][_u][_v] +
-       wtuv_u_v[t][n1][n2][_v][_u] ) *
+                      forwardingCost += 0.001 * ( wtuv_u_v(t, n1, n2, _u, _v) +
+       wtuv_u_v(t, n1, n2, _v, _u) ) *
                                                 beta_t * per_bit_transit_cost *
        traffic_requests[t].duration;
                     }
@@ -1053,8 +1112,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
                 for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
                   for (int _v : _nbr[_u]) {
                     if (_u < _v) {
-                      delay += (wtuv_u_v[t][n1][n2][_u][_v] * delta_u_v[_u][_v]
-       + wtuv_u_v[t][n1][n2][_v][_u] * delta_u_v[_v][_u]);
+                      delay += (wtuv_u_v(t, n1, n2, _u, _v) * delta_u_v[_u][_v]
+       + wtuv_u_v(t, n1, n2, _v, _u) * delta_u_v[_v][_u]);
                     }
                   }
                 }
@@ -1108,13 +1167,32 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     cplex.setParam(IloCplex::TiLim, timeLimit);
     // cplex.setParam(IloCplex::EpGap, relativeGap);
     cplex.setParam(IloCplex::Threads, 8);
+    // timestamps solved at the same time share the cores
+    if (cplex_workers > 1) {
+      cplex.setParam(IloCplex::Threads, GetWorkerCplexThreads());
+    }
     cplex.setParam(IloCplex::MemoryEmphasis, true);
     cplex.setParam(IloCplex::PreDual, true);
+    // a feasibility probe stops at the first incumbent and shares the cores
+    // with the probes running next to it
+    if (feasibility_only) {
+      cplex.setParam(IloCplex::IntSolLim, 1);
+      cplex.setParam(IloCplex::Threads, GetProbeCplexThreads());
+    }
+    // start from the Viterbi placement of the same traffic
+    if (!warm_start.empty()) {
+      AddViterbiWarmStart(env, cplex, traffic_requests, warm_start, kMboxCount,
+                          mboxType, server4mbox, switch4server, switch4mbox,
+                          kSwitchCount, ym, xtnm, ztn_n, wtuv_u_v);
+    }
+    telemetry.Attach(env, cplex);
     if (!cplex.solve()) {
       timer.stop();
+      telemetry.Finish(cplex);
       // cout << "Could not solve ILP!" << endl;
       // cout << "Solution Status = " << cplex.getStatus() << endl;
       is_feasible = 0;
+      env.end();
       return;
       /*
       cout << "cnst size " << cnst.getSize() << endl;
@@ -1134,13 +1212,23 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
       // throw(-1);
     }
     timer.stop();
+    telemetry.Finish(cplex);
 
     // opex = cplex.getObjValue();
 
     // cout << "Solution Status = " << cplex.getStatus() << endl;
     is_feasible = 1;
+    if (feasibility_only) {
+      env.end();
+      return;
+    }
     // cout << "Solution Value = " << opex << endl;
 
+    // read the solution once; everything below is derived from these values
+    const SolutionValues3d xtnm_vals(cplex, xtnm);
+    const SolutionValues3d ztn_n_vals(cplex, ztn_n);
+    wtuv_u_v.ReadValues(cplex);
+
     // print xtnm
     // cout << endl;
     for (int t = 0; t < kTrafficCount; ++t) {
@@ -1148,7 +1236,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
         // IloNumArray xtnm_vals(env, kMboxCount);
         // cplex.getValues(xtnm[t][n], xtnm_vals);
         for (int m = 0; m < kMboxCount; ++m) {
-          if (fabs(cplex.getValue(xtnm[t][n][m]) - 1) < EPS) {
+          if (fabs(xtnm_vals(t, n, m) - 1) < EPS) {
             sequence[t].push_back(pseudo2actual[switch4mbox[m]]);
             DEBUG("Traffic %d node %d provisioned on middlebox %d\n", t, n, m);
           }
@@ -1183,10 +1271,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
     // cout << endl;
     for (int t = 0; t < kTrafficCount; ++t) {
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
-        IloNumArray ztn_n_vals(env, kSwitchCount);
-        cplex.getValues(ztn_n[t][n], ztn_n_vals);
         for (int _s = 0; _s < kSwitchCount; ++_s) {
-          if (fabs(ztn_n_vals[_s] - 1) < EPS) {
+          if (fabs(ztn_n_vals(t, n, _s) - 1) < EPS) {
             DEBUG(
                 "Traffic %d node %d provisioned on switch %d pseudo-switch "
                 "%d\n",
@@ -1206,7 +1292,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               IloNum value;
               for (int _v : __nbr[_u]) {
-                value = cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]);
+                value = wtuv_u_v.value(t, n1, n2, _u, _v);
                 if (fabs(value - 1) < EPS) {
                   // DEBUG("Traffic %d link (%d, %d) mapped to phy. link (%d,
                   // %d)\n", t, n1, n2, _u, _v);
@@ -1234,11 +1320,9 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
 
     IloNum depCost = 0.0;
     IloNum enrCost = 0.0;
-    IloNumArray ym_vals2(env, kMboxCount);
-    cplex.getValues(ym, ym_vals2);
 
     for (int m = 0; m < kMboxCount; ++m) {
-      depCost += D_m[m] * ym_vals2[m];
+      depCost += D_m[m] * ym_vals[m];
     }
     opex_breakdown.push_back(depCost);
 
@@ -1250,7 +1334,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
           if (mboxType[m] == 0 || mboxType[m] == 1) {
             continue;
           }
-          used_cpu += ym_vals2[m] * cmr[m][0];
+          used_cpu += ym_vals[m] * cmr[m][0];
         }
         per_server_energy = POWER_CONSUMPTION_ONE_SERVER(used_cpu) *
                             duration_hours * PER_UNIT_ENERGY_PRICE;
@@ -1272,8 +1356,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  value = cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                          cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u]);
+                  value = wtuv_u_v.value(t, n1, n2, _u, _v) +
+                          wtuv_u_v.value(t, n1, n2, _v, _u);
                   fwdCost += 0.001 * value * beta_t * per_bit_transit_cost *
                              traffic_requests[t].duration;
                 }
@@ -1297,8 +1381,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  delay += (cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                            cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u])) *
+                  delay += (wtuv_u_v.value(t, n1, n2, _u, _v) +
+                            wtuv_u_v.value(t, n1, n2, _v, _u)) *
                            delta_u_v[_u][_v];
                 }
               }
@@ -1310,7 +1394,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
       // middlebox processing delay
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
         for (int m = 0; m < kMboxCount; ++m) {
-          delay += cplex.getValue(xtnm[t][n][m]) * delta_m[m];
+          delay += xtnm_vals(t, n, m) * delta_m[m];
           // if (cplex.getValue(xtnm[t][n][m] == 1))
           //  cout << "t = " << t << " n = " << n << " delay " << delay << endl;
         }
@@ -1327,7 +1411,7 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
          ++_n) {
       consumed_cores = 0;
       for (int m : mbox4server[_n]) {
-        consumed_cores += ym_vals2[m] * cmr[m][0];
+        consumed_cores += ym_vals[m] * cmr[m][0];
       }
       utilization.push_back(consumed_cores);
     }
@@ -1340,8 +1424,8 @@ void run_cplex_opt(std::vector<traffic_request> traffic_requests, double &opex,
             for (int n2 : nbr[t][n1]) {
               if (n1 < n2) {
                 allocated_bandwidth +=
-                    (cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                     cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u])) *
+                    (wtuv_u_v.value(t, n1, n2, _u, _v) +
+                     wtuv_u_v.value(t, n1, n2, _v, _u)) *
                     traffic_requests[t].min_bandwidth;
               }
             }
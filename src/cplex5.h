@@ -9,6 +9,15 @@ actual servers
 
 */
 
+#include "cplex_candidates.h"
+#include "cplex_flow.h"
+#include "cplex_lns.h"
+#include "cplex_network.h"
+#include "cplex_solution.h"
+#include "cplex_symmetry.h"
+#include "cplex_telemetry.h"
+#include "cplex_threads.h"
+#include "cplex_warm_start.h"
 #include "datastructure.h"
 #include "util.h"
 #include <string>
@@ -22,7 +31,6 @@ ILOSTLBEGIN
 typedef IloArray<IloIntVarArray> IloIntVar2dArray;
 typedef IloArray<IloIntVar2dArray> IloIntVar3dArray;
 typedef IloArray<IloIntVar3dArray> IloIntVar4dArray;
-typedef IloArray<IloIntVar4dArray> IloIntVar5dArray;
 
 typedef IloArray<IloIntArray> IloInt2dArray;
 typedef IloArray<IloInt2dArray> IloInt3dArray;
@@ -69,9 +77,12 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
                std::vector<int> &utilization, string topology_filename) {
   IloEnv env;
   try {
+    CplexTelemetry telemetry(traffic_requests, "solve");
     // declare the model and the solver
     IloModel model(env);
     IloCplex cplex(model);
+    // couple the variables with linear inequalities instead of IloIfThen
+    const bool kLinearFormulation = cplex_formulation == "linear";
     // cplex.setParam(IloCplex::DataCheck, 1);
 
     // save all the constraints for model checking
@@ -86,11 +97,12 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
 
     int kSwitchCount = 0, kLinkCount = 0, kServerCount = 0, kResourceCount = 0;
 
-    // read topology file and populate associated variables
-    FILE *topology_file = fopen(topology_filename.c_str(), "r");
+    // the physical network is built once and shared by all calls
+    const physical_network &network = GetPhysicalNetwork();
 
-    // read switch and link count
-    fscanf(topology_file, "%d %d", &kSwitchCount, &kLinkCount);
+    // switch and link count
+    kSwitchCount = network.switch_count;
+    kLinkCount = network.links.size();
     // ingress and egress middleboxes are deployed on special non-existent
     // servers
     // kServerCount += kSwitchCount;  // these are the special ones
@@ -121,14 +133,14 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     */
 
     // Declare the required DSs
-    std::vector<int> _nbr[kSwitchCount];
+    const std::vector<int> *_nbr = network.nbr.data();
     int switch4server[kServerCount];
     std::vector<int> server4switch[kSwitchCount];
     int actual_server[kServerCount];
-    bandwidth _beta[kSwitchCount][kSwitchCount];
-    int _delta[kSwitchCount][kSwitchCount];
-    bandwidth max_beta = 0;
-    int max_delta = 0;
+    const matrix<long> &_beta = network.beta;
+    const matrix<int> &_delta = network.delta;
+    bandwidth max_beta = network.max_beta;
+    int max_delta = network.max_delta;
 
     //////////CPLEX Variable//////////
     //_z_s_n = 1, iff _n is attached to _s
@@ -161,9 +173,10 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     }
     */
 
-    // read the switch info from file
+    // read the switch info
     for (int i = 0, sw, cpu; i < kSwitchCount; ++i) {
-      fscanf(topology_file, "%d %d", &sw, &cpu);
+      sw = network.switches[i].first;
+      cpu = network.switches[i].second;
       //_z_s_n[sw][sw] = 1;  // for the special ones
       //_z_s_n[sw][sw + kSwitchCount] = 1;  // these is where we deploy normal
       //middleboxes
@@ -206,39 +219,6 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     // print_IloInt2dArray(c_nr, kServerCount, kResourceCount, "c_nr");
     */
 
-    // initialize _beta & _delta to remove any garbage value
-    for (int _u = 0; _u < kSwitchCount; ++_u) {
-      for (int _v = 0; _v < kSwitchCount; ++_v) {
-        _beta[_u][_v] = _delta[_u][_v] = 0;
-      }
-    }
-
-    // read link info from file
-    bandwidth b;
-    for (int _l = 0, _u, _v, d; _l < kLinkCount; ++_l) {
-#ifdef LONGBAND
-      fscanf(topology_file, "%d %d %ld %d", &_u, &_v, &b, &d);
-#else
-      fscanf(topology_file, "%d %d %d %d", &_u, &_v, &b, &d);
-#endif
-      _beta[_u][_v] = b;
-      _beta[_v][_u] = b;
-      _delta[_u][_v] = d;
-      _delta[_v][_u] = d;
-      //_nbr
-      _nbr[_u].push_back(_v);
-      _nbr[_v].push_back(_u);
-      // max_beta & max_delta
-      max_beta = max(max_beta, b);
-      max_delta = max(max_delta, d);
-
-      // cout << "Bandwidth " << _beta[_u][_v] << endl;
-    }
-
-    // print_IloInt2dArray(_u_s_l, kSwitchCount, kLinkCount, "_u_s_l");
-    // print_IloInt2dArray(_v_s_l, kSwitchCount, kLinkCount, "_v_s_l");
-
-    fclose(topology_file);
 
     DEBUG("Done.\n");
 
@@ -594,6 +574,25 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
       xtnm[t] = IloIntVar2dArray(env, trafficNodeCount[t]);
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
         xtnm[t][n] = IloIntVarArray(env, kMboxCount, 0, 1);
+        // the linear formulation fixes the middleboxes of another type to 0,
+        // so presolve removes them instead of branching on the type match
+        for (int m = 0; kLinearFormulation && m < kMboxCount; ++m) {
+          if (mboxType[m] != trafficNodeType[t][n]) xtnm[t][n][m].setUB(0);
+        }
+      }
+    }
+    // fix the instances a node can not or should not use to 0
+    if (cplex_pruning != "off") {
+      const std::vector<std::vector<std::vector<char> > > kCandidates =
+          ComputeCandidateInstances(traffic_requests, kMboxCount, mboxType,
+                                    server4mbox, switch4server, 0,
+                                    cplex_pruning == "sla");
+      for (int t = 0; t < kTrafficCount; ++t) {
+        for (int n = 0; n < trafficNodeCount[t]; ++n) {
+          for (int m = 0; m < kMboxCount; ++m) {
+            if (!kCandidates[t][n][m]) xtnm[t][n][m].setUB(0);
+          }
+        }
       }
     }
     //^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
@@ -646,9 +645,28 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     //  }
     //}
 
+    //-----CPLEX Constraint------------------------------------------------
+    // ADD: symmetry breaking among the instances of a type on a server
+    if (cplex_symmetry != "off") {
+      AddInstanceSymmetryBreaking(env, model, traffic_requests, kMboxCount,
+                                  mboxType, server4mbox, ym, xtnm,
+                                  cplex_symmetry == "load");
+    }
+    //---------------------------------------------------------------------
+
     //-----CPLEX Constraint------------------------------------------------
     // ADD: constraint fot ym
     for (int m = 0; m < kMboxCount; ++m) {
+      if (kLinearFormulation) {
+        // one row per node that may use m, not one big-M row over all the
+        // nodes: it keeps ym[m] >= xtnm in the LP relaxation
+        for (int t = 0; t < kTrafficCount; ++t) {
+          for (int n = 0; n < trafficNodeCount[t]; ++n) {
+            if (xtnm[t][n][m].getUB() > 0) model.add(xtnm[t][n][m] <= ym[m]);
+          }
+        }
+        continue;
+      }
       IloIntExpr sum(env);
       for (int t = 0; t < kTrafficCount; ++t) {
         for (int n = 0; n < trafficNodeCount[t]; ++n) {
@@ -672,8 +690,12 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
 
           for (int _s = 0; _s < kSwitchCount; ++_s) {
             if (switch4mbox[m] == _s) {
-              model.add(
-                  IloIfThen(env, xtnm[t][n][m] == 1, ztn_n[t][n][_s] == 1));
+              if (kLinearFormulation) {
+                model.add(xtnm[t][n][m] <= ztn_n[t][n][_s]);
+              } else {
+                model.add(
+                    IloIfThen(env, xtnm[t][n][m] == 1, ztn_n[t][n][_s] == 1));
+              }
             }
           }
         }
@@ -717,6 +739,12 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
       u_t = traffic_requests[t].source;
       v_t = traffic_requests[t].destination;
       for (int m = 0; m < kMboxCount; ++m) {
+        if (kLinearFormulation) {
+          model.add(xtnm[t][0][m] <= ym[m] * _z_s_n[u_t][server4mbox[m]]);
+          model.add(xtnm[t][trafficNodeCount[t] - 1][m] <=
+                    ym[m] * _z_s_n[v_t][server4mbox[m]]);
+          continue;
+        }
         model.add(IloIfThen(env, xtnm[t][0][m] == 1,
                             ym[m] * _z_s_n[u_t][server4mbox[m]] == 1));
         model.add(IloIfThen(env, xtnm[t][trafficNodeCount[t] - 1][m] == 1,
@@ -728,40 +756,19 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
 
     //^^^^^CPLEX Decision Variable^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
     // wtuv_u_v = 1, if logical link (u, v) of traffic t uses physical link (_u,
-    // _v)
-    IloIntVar5dArray wtuv_u_v(env, kTrafficCount);
-    for (int t = 0; t < kTrafficCount; ++t) {
-      wtuv_u_v[t] = IloIntVar4dArray(env, trafficNodeCount[t]);
-      for (int u = 0; u < trafficNodeCount[t]; ++u) {
-        wtuv_u_v[t][u] = IloIntVar3dArray(env, trafficNodeCount[t]);
-        for (int v = 0; v < trafficNodeCount[t]; ++v) {
-          wtuv_u_v[t][u][v] = IloIntVar2dArray(env, kSwitchCount);
-          for (int _u = 0; _u < kSwitchCount; ++_u) {
-            wtuv_u_v[t][u][v][_u] = IloIntVarArray(env, kSwitchCount, 0, 1);
-          }
-        }
-      }
-    }
-    /*
-    IloIntVar5dArray wtuv_u_v(env, kTrafficCount);
-    for (int t = 0; t < kTrafficCount; ++t) {
-      wtuv_u_v[t] = IloIntVar4dArray(env, trafficNodeCount[t]);
-      for (int u = 0; u < trafficNodeCount[t]; ++u) {
-        wtuv_u_v[t][u] = IloIntVar3dArray(env, nbr[t].size());
-        for (int v : nbr[t][u]) {
-          wtuv_u_v[t][u][v] = IloIntVar2dArray(env, kSwitchCount);
-          for (int _u = 0; _u < kSwitchCount; ++_u) {
-            wtuv_u_v[t][u][v][_u] = IloIntVarArray(env, kSwitchCount, 0, 1);
-          }
-        }
-      }
-    }
-    */
+    // _v). Only chain-adjacent logical links and existing physical links
+    // have a variable.
+    FlowVariables wtuv_u_v(env, kTrafficCount, nbr, kSwitchCount, _nbr,
+                           true);
     //^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
     // cout << "w done" << endl;
 
     //-----CPLEX Constraint------------------------------------------------
     // ADD: physical link capacity constraint
+    // with --cplex_lazy_links, the rows go to the lazy constraint pool:
+    // CPLEX leaves them out of the LP relaxation and adds a row only when
+    // a candidate incumbent violates it
+    IloConstraintArray lazy_link_capacity(env);
     // cout << "kSwitchCount " << kSwitchCount << endl;
     for (int _u = 0; _u < kSwitchCount; ++_u) {
       for (int _v : _nbr[_u]) {
@@ -772,8 +779,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int n1 = 0; n1 < trafficNodeCount[t]; ++n1) {
               for (int n2 : nbr[t][n1]) {
                 if (n1 < n2) {
-                  sum += (wtuv_u_v[t][n1][n2][_u][_v] +
-                          wtuv_u_v[t][n1][n2][_v][_u]) *
+                  sum += (wtuv_u_v(t, n1, n2, _u, _v) +
+                          wtuv_u_v(t, n1, n2, _v, _u)) *
                          beta_t;
                 }
               }
@@ -781,10 +788,17 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
           }
           // cout << "_u _v " << _u << " " << _v << " " << _beta[_u][_v] <<
           // endl;
-          model.add(sum <= _beta[_u][_v]);
+          if (use_cplex_lazy_links) {
+            lazy_link_capacity.add(sum <= _beta[_u][_v]);
+          } else {
+            model.add(sum <= _beta[_u][_v]);
+          }
         }
       }
     }
+    if (lazy_link_capacity.getSize() > 0) {
+      cplex.addLazyConstraints(lazy_link_capacity);
+    }
     //---------------------------------------------------------------------
     // cout << "cnst physical link" << endl;
 
@@ -798,17 +812,17 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
               IloIntExpr sum(env);
               for (int _v : _nbr[_u]) {
                 sum +=
-                    wtuv_u_v[t][n1][n2][_u][_v] - wtuv_u_v[t][n1][n2][_v][_u];
+                    wtuv_u_v(t, n1, n2, _u, _v) - wtuv_u_v(t, n1, n2, _v, _u);
                 if (_u < _v) {
-                  model.add(wtuv_u_v[t][n1][n2][_u][_v] +
-                                wtuv_u_v[t][n1][n2][_v][_u] <=
+                  model.add(wtuv_u_v(t, n1, n2, _u, _v) +
+                                wtuv_u_v(t, n1, n2, _v, _u) <=
                             1);
                 }
               }
               model.add(sum == (ztn_n[t][n1][_u] - ztn_n[t][n2][_u]));
               // the following constraint is for consecutive middleboxed
               // attached to the same switch
-              model.add(wtuv_u_v[t][n1][n2][_u][_u] >=
+              model.add(wtuv_u_v(t, n1, n2, _u, _u) >=
                         ztn_n[t][n1][_u] + ztn_n[t][n2][_u] - 1);
             }
           }
@@ -827,17 +841,22 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
           IloExpr normal_edge_sum(env);
           for (int _u = 0; _u < kSwitchCount; ++_u) {
             for (int _v : _nbr[_u]) {
-              sum += wtuv_u_v[t][n1][n2][_u][_v];
-              normal_edge_sum += wtuv_u_v[t][n1][n2][_u][_v];
+              sum += wtuv_u_v(t, n1, n2, _u, _v);
+              normal_edge_sum += wtuv_u_v(t, n1, n2, _u, _v);
             }
-            sum += wtuv_u_v[t][n1][n2][_u][_u];
-            self_loop_sum += wtuv_u_v[t][n1][n2][_u][_u];
+            sum += wtuv_u_v(t, n1, n2, _u, _u);
+            self_loop_sum += wtuv_u_v(t, n1, n2, _u, _u);
           }
           model.add(sum > 0);
-          model.add(IloIfThen(env, normal_edge_sum == 0,
-                              0 <= self_loop_sum <= 1));  // at most one
-                                                          // self-loop for a
-                                                          // single link
+          if (kLinearFormulation) {
+            // at most one self-loop for a link without normal edges
+            model.add(self_loop_sum - kSwitchCount * normal_edge_sum <= 1);
+          } else {
+            model.add(IloIfThen(env, normal_edge_sum == 0,
+                                0 <= self_loop_sum <= 1));  // at most one
+                                                            // self-loop for a
+                                                            // single link
+          }
         }
       }
     }
@@ -883,7 +902,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     // it also includes the middlebox type constraint
     for (int t = 0; t < kTrafficCount; ++t) {
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
-        for (int m = 0; m < kMboxCount; ++m) {
+        // enforced by the bounds of xtnm in the linear formulation
+        for (int m = 0; !kLinearFormulation && m < kMboxCount; ++m) {
           // IloExpr sum_mbox(env);
           // for (int _n = 0; _n < kServerCount; ++_n) {
           //  sum_mbox += bm_n[m][_n];
@@ -931,7 +951,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             //link delay
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
-                delay += wtuv_u_v[t][n1][n2][_u][_v] * delta_u_v[_u][_v];
+                delay += wtuv_u_v(t, n1, n2, _u, _v) * delta_u_v[_u][_v];
               }
             }
           }
@@ -996,13 +1016,13 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  forwardingCost += 0.001 * (wtuv_u_v[t][n1][n2][_u][_v] +
-                                             wtuv_u_v[t][n1][n2][_v][_u]) *
+                  forwardingCost += 0.001 * (wtuv_u_v(t, n1, n2, _u, _v) +
+                                             wtuv_u_v(t, n1, n2, _v, _u)) *
                                     beta_t * per_bit_transit_cost *
                                     traffic_requests[t].duration;
                 }
               }
-              forwardingCost += wtuv_u_v[t][n1][n2][_u][_u] * 0.0;
+              forwardingCost += wtuv_u_v(t, n1, n2, _u, _u) * 0.0;
             }
           }
         }
@@ -1022,8 +1042,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  delay += (wtuv_u_v[t][n1][n2][_u][_v] * _delta[_u][_v] +
-                            wtuv_u_v[t][n1][n2][_v][_u] * _delta[_v][_u]);
+                  delay += (wtuv_u_v(t, n1, n2, _u, _v) * _delta[_u][_v] +
+                            wtuv_u_v(t, n1, n2, _v, _u) * _delta[_v][_u]);
                 }
               }
             }
@@ -1036,8 +1056,15 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
           delay += xtnm[t][n][m] * delta_m[m];
         }
       }
-      penalty += ((delay - tr.max_delay) + IloAbs(delay - tr.max_delay)) / 2.0 *
-                 tr.delay_penalty;
+      if (kLinearFormulation) {
+        // the violation is pushed down to max(0, delay - max_delay)
+        IloNumVar violation(env, 0, IloInfinity);
+        model.add(violation >= delay - tr.max_delay);
+        penalty += violation * tr.delay_penalty;
+      } else {
+        penalty += ((delay - tr.max_delay) + IloAbs(delay - tr.max_delay)) /
+                   2.0 * tr.delay_penalty;
+      }
     }
     objective += lambda * penalty;
 
@@ -1065,10 +1092,30 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     cplex.setParam(IloCplex::TiLim, timeLimit);
     // cplex.setParam(IloCplex::EpGap, relativeGap);
     // cplex.setParam(IloCplex::Threads, 2);
+    // timestamps solved at the same time share the cores
+    if (cplex_workers > 1) {
+      cplex.setParam(IloCplex::Threads, GetWorkerCplexThreads());
+    }
     cplex.setParam(IloCplex::MemoryEmphasis, true);
     cplex.setParam(IloCplex::PreDual, true);
-    if (!cplex.solve()) {
+    // start from the Viterbi placement of the same traffic
+    if (use_cplex_warm_start || cplex_lns_iterations > 0) {
+      AddViterbiWarmStart(env, cplex, traffic_requests,
+                          ComputeViterbiPlacement(traffic_requests), kMboxCount,
+                          mboxType, server4mbox, switch4server,
+                          switch4mbox.data(), kSwitchCount, ym, xtnm, ztn_n,
+                          wtuv_u_v);
+    }
+    telemetry.Attach(env, cplex);
+    const bool kSolved =
+        cplex_lns_iterations > 0
+            ? SolveWithLns(cplex, traffic_requests, kMboxCount, mboxType,
+                           server4mbox, ym, xtnm, ztn_n, wtuv_u_v,
+                           cplex_lns_iterations, &telemetry)
+            : cplex.solve();
+    if (!kSolved) {
       timer.stop();
+      telemetry.Finish(cplex);
       cout << "Could not solve ILP!" << endl;
       cout << "Solution Status = " << cplex.getStatus() << endl;
       /*
@@ -1089,12 +1136,18 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
       throw(-1);
     }
     timer.stop();
+    telemetry.Finish(cplex);
 
     opex = cplex.getObjValue();
 
     // cout << "Solution Status = " << cplex.getStatus() << endl;
     // cout << "Solution Value = " << opex << endl;
 
+    // read the solution once; everything below is derived from these values
+    const SolutionValues3d xtnm_vals(cplex, xtnm);
+    const SolutionValues3d ztn_n_vals(cplex, ztn_n);
+    wtuv_u_v.ReadValues(cplex);
+
     // print xtnm
     // cout << endl;
     for (int t = 0; t < kTrafficCount; ++t) {
@@ -1102,7 +1155,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
         // IloNumArray xtnm_vals(env, kMboxCount);
         // cplex.getValues(xtnm[t][n], xtnm_vals);
         for (int m = 0; m < kMboxCount; ++m) {
-          if (fabs(cplex.getValue(xtnm[t][n][m]) - 1) < EPS) {
+          if (fabs(xtnm_vals(t, n, m) - 1) < EPS) {
             sequence[t].push_back(switch4mbox[m]);
             DEBUG("Traffic %d node %d provisioned on middlebox %d\n", t, n, m);
           }
@@ -1137,10 +1190,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     // cout << endl;
     for (int t = 0; t < kTrafficCount; ++t) {
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
-        IloNumArray ztn_n_vals(env, kSwitchCount);
-        cplex.getValues(ztn_n[t][n], ztn_n_vals);
         for (int _s = 0; _s < kSwitchCount; ++_s) {
-          if (fabs(ztn_n_vals[_s] - 1) < EPS) {
+          if (fabs(ztn_n_vals(t, n, _s) - 1) < EPS) {
             DEBUG(
                 "Traffic %d node %d provisioned on switch %d pseudo-switch "
                 "%d\n",
@@ -1159,7 +1210,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               IloNum value;
               // self-loops
-              value = cplex.getValue(wtuv_u_v[t][n1][n2][_u][_u]);
+              value = wtuv_u_v.value(t, n1, n2, _u, _u);
               if (fabs(value - 1) < EPS) {
                 DEBUG("Traffic %d link (%d, %d) mapped to phy. link (%d, %d)\n",
                       t, n1, n2, _u, _u);
@@ -1170,7 +1221,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
               }
               // other edges
               for (int _v : _nbr[_u]) {
-                value = cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]);
+                value = wtuv_u_v.value(t, n1, n2, _u, _v);
                 if (fabs(value - 1) < EPS) {
                   DEBUG(
                       "Traffic %d link (%d, %d) mapped to phy. link (%d, %d)\n",
@@ -1189,11 +1240,9 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
 
     IloNum depCost = 0.0;
     IloNum enrCost = 0.0;
-    IloNumArray ym_vals2(env, kMboxCount);
-    cplex.getValues(ym, ym_vals2);
 
     for (int m = 0; m < kMboxCount; ++m) {
-      depCost += D_m[m] * ym_vals2[m];
+      depCost += D_m[m] * ym_vals[m];
     }
     opex_breakdown.push_back(depCost);
 
@@ -1205,7 +1254,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
           if (mboxType[m] == 0 || mboxType[m] == 1) {
             continue;
           }
-          used_cpu += ym_vals2[m] * cmr[m][0];
+          used_cpu += ym_vals[m] * cmr[m][0];
         }
         per_server_energy = POWER_CONSUMPTION_ONE_SERVER(used_cpu) *
                             duration_hours * PER_UNIT_ENERGY_PRICE;
@@ -1227,8 +1276,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  value = cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                          cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u]);
+                  value = wtuv_u_v.value(t, n1, n2, _u, _v) +
+                          wtuv_u_v.value(t, n1, n2, _v, _u);
                   // cout << "VALUE " << value << endl;
                   fwdCost += 0.001 * value * beta_t * per_bit_transit_cost *
                              traffic_requests[t].duration;
@@ -1253,8 +1302,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int _u = 0; _u < kSwitchCount; ++_u) {
               for (int _v : _nbr[_u]) {
                 if (_u < _v) {
-                  delay += (cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                            cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u])) *
+                  delay += (wtuv_u_v.value(t, n1, n2, _u, _v) +
+                            wtuv_u_v.value(t, n1, n2, _v, _u)) *
                            _delta[_u][_v];
                 }
               }
@@ -1266,7 +1315,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
       // middlebox processing delay
       for (int n = 0; n < trafficNodeCount[t]; ++n) {
         for (int m = 0; m < kMboxCount; ++m) {
-          delay += cplex.getValue(xtnm[t][n][m]) * delta_m[m];
+          delay += xtnm_vals(t, n, m) * delta_m[m];
           // if (cplex.getValue(xtnm[t][n][m] == 1))
           //  cout << "t = " << t << " n = " << n << " delay " << delay << endl;
         }
@@ -1282,7 +1331,7 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
     for (int _n = 0, consumed_cores; _n < kServerCount; ++_n) {
       consumed_cores = 0;
       for (int m : mbox4server[_n]) {
-        consumed_cores += ym_vals2[m] * cmr[m][0];
+        consumed_cores += ym_vals[m] * cmr[m][0];
       }
       utilization.push_back(consumed_cores);
     }
@@ -1295,8 +1344,8 @@ void run_cplex(std::vector<traffic_request> traffic_requests, double &opex,
             for (int n2 : nbr[t][n1]) {
               if (n1 < n2) {
                 allocated_bandwidth +=
-                    (cplex.getValue(wtuv_u_v[t][n1][n2][_u][_v]) +
-                     cplex.getValue(wtuv_u_v[t][n1][n2][_v][_u])) *
+                    (wtuv_u_v.value(t, n1, n2, _u, _v) +
+                     wtuv_u_v.value(t, n1, n2, _v, _u)) *
                     traffic_requests[t].min_bandwidth;
               }
             }
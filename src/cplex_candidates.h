@@ -0,0 +1,73 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_CANDIDATES_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_CANDIDATES_H_
+
+#include "datastructure.h"
+
+#include <algorithm>
+#include <vector>
+
+// Computes candidates[t][n][m], whether node n of traffic t (ingress,
+// middleboxes, egress) may be placed on middlebox instance m. Instances are
+// ruled out if
+//  - they are of another type,
+//  - for the ingress and egress, they are not on the source or destination
+//    switch,
+//  - their processing capacity plus capacity_slack, the slack the model
+//    allows, is below the bandwidth of the traffic,
+// which the model forbids anyway. With use_delay_radius, a middlebox instance
+// is also ruled out if the shortest path from the source over its switch to
+// the destination plus the processing delay of the chain exceeds max_delay.
+// As the models only penalize such a delay, a node keeps all its other
+// candidates if every one of them is that far.
+std::vector<std::vector<std::vector<char> > > ComputeCandidateInstances(
+    const std::vector<traffic_request> &traffic_requests, int kMboxCount,
+    const std::vector<int> &mboxType, const std::vector<int> &server4mbox,
+    const int *switch4server, long capacity_slack, bool use_delay_radius) {
+  const int kTrafficCount = traffic_requests.size();
+  std::vector<std::vector<std::vector<char> > > candidates(kTrafficCount);
+  for (int t = 0; t < kTrafficCount; ++t) {
+    const traffic_request &tr = traffic_requests[t];
+    const int kNodeCount = tr.middlebox_sequence.size() + 2;
+    long chain_delay = 0;
+    for (int p : tr.middlebox_sequence) {
+      chain_delay += middleboxes[p].processing_delay;
+    }
+    candidates[t].assign(kNodeCount, std::vector<char>(kMboxCount, 0));
+    for (int n = 0; n < kNodeCount; ++n) {
+      int type = 0;
+      if (n == kNodeCount - 1) {
+        type = 1;
+      } else if (n > 0) {
+        type = tr.middlebox_sequence[n - 1] + 2;
+      }
+      std::vector<char> &node_candidates = candidates[t][n];
+      std::vector<int> far_instances;
+      for (int m = 0; m < kMboxCount; ++m) {
+        if (mboxType[m] != type) continue;
+        const int kSwitch = switch4server[server4mbox[m]];
+        if (type == 0 && kSwitch != tr.source) continue;
+        if (type == 1 && kSwitch != tr.destination) continue;
+        if (type >= 2 && middleboxes[type - 2].processing_capacity +
+                                 capacity_slack <
+                             tr.min_bandwidth) {
+          continue;
+        }
+        if (use_delay_radius && type >= 2 &&
+            static_cast<long>(shortest_path[tr.source][kSwitch]) +
+                    shortest_path[kSwitch][tr.destination] + chain_delay >
+                tr.max_delay) {
+          far_instances.push_back(m);
+          continue;
+        }
+        node_candidates[m] = 1;
+      }
+      if (std::find(node_candidates.begin(), node_candidates.end(), 1) ==
+          node_candidates.end()) {
+        for (int m : far_instances) node_candidates[m] = 1;
+      }
+    }
+  }
+  return candidates;
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_CANDIDATES_H_
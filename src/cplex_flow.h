@@ -0,0 +1,109 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_FLOW_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_FLOW_H_
+
+#include <assert.h>
+#include <unordered_map>
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// Binary flow variables of the CPLEX models: w(t, n1, n2, _u, _v) = 1 iff the
+// logical link (n1, n2) of traffic t is routed over the directed physical
+// link (_u, _v). Variables exist only for the combinations the constraints
+// use, i.e., n2 in nbr[t][n1] and _v in switch_nbr[_u] (and _v == _u if
+// self_loops is set), so a model has T * n * E of them instead of
+// T * n^2 * S^2. They are stored in one array, segment by segment, each
+// segment holding one variable per physical link.
+class FlowVariables {
+ public:
+  FlowVariables(IloEnv env, int traffic_count,
+                const std::vector<std::vector<int> > *nbr, int switch_count,
+                const std::vector<int> *switch_nbr, bool self_loops)
+      : switch_count_(switch_count), num_links_(0) {
+    for (int _u = 0; _u < switch_count; ++_u) {
+      for (int _v : switch_nbr[_u]) AddLink(_u, _v);
+      if (self_loops) AddLink(_u, _u);
+    }
+    int num_segments = 0;
+    segment_first_.resize(traffic_count);
+    nbr_.resize(traffic_count);
+    traffic_first_.resize(traffic_count + 1);
+    for (int t = 0; t < traffic_count; ++t) {
+      traffic_first_[t] = static_cast<IloInt>(num_segments) * num_links_;
+      nbr_[t] = nbr[t];
+      for (const std::vector<int> &node_nbr : nbr[t]) {
+        segment_first_[t].push_back(num_segments);
+        num_segments += node_nbr.size();
+      }
+    }
+    traffic_first_[traffic_count] =
+        static_cast<IloInt>(num_segments) * num_links_;
+    vars_ = IloIntVarArray(env, traffic_first_[traffic_count], 0, 1);
+  }
+
+  IloIntVar operator()(int t, int n1, int n2, int _u, int _v) const {
+    return vars_[Index(t, n1, n2, _u, _v)];
+  }
+
+  // Position of w(t, n1, n2, _u, _v) in vars().
+  IloInt Index(int t, int n1, int n2, int _u, int _v) const {
+    return static_cast<IloInt>(SegmentIndex(t, n1, n2)) * num_links_ +
+           LinkIndex(_u, _v);
+  }
+
+  // The variables of traffic t are vars()[TrafficBegin(t), TrafficEnd(t)).
+  IloInt TrafficBegin(int t) const { return traffic_first_[t]; }
+  IloInt TrafficEnd(int t) const { return traffic_first_[t + 1]; }
+
+  // All variables, e.g., to read a solution with one getValues call.
+  const IloIntVarArray &vars() const { return vars_; }
+
+  // Reads the values of all variables in the current solution with one
+  // getValues call; value() looks them up afterwards.
+  void ReadValues(IloCplex cplex) {
+    IloNumArray values(vars_.getEnv(), vars_.getSize());
+    cplex.getValues(vars_, values);
+    values_.resize(vars_.getSize());
+    for (IloInt i = 0; i < vars_.getSize(); ++i) values_[i] = values[i];
+    values.end();
+  }
+
+  double value(int t, int n1, int n2, int _u, int _v) const {
+    return values_[Index(t, n1, n2, _u, _v)];
+  }
+
+ private:
+  void AddLink(int _u, int _v) {
+    if (link_index_.emplace(LinkKey(_u, _v), num_links_).second) ++num_links_;
+  }
+
+  long long LinkKey(int _u, int _v) const {
+    return static_cast<long long>(_u) * switch_count_ + _v;
+  }
+
+  int LinkIndex(int _u, int _v) const {
+    auto it = link_index_.find(LinkKey(_u, _v));
+    assert(it != link_index_.end());
+    return it->second;
+  }
+
+  int SegmentIndex(int t, int n1, int n2) const {
+    const std::vector<int> &node_nbr = nbr_[t][n1];
+    for (int i = 0; i < node_nbr.size(); ++i) {
+      if (node_nbr[i] == n2) return segment_first_[t][n1] + i;
+    }
+    assert(false);
+    return -1;
+  }
+
+  int switch_count_;
+  int num_links_;
+  std::unordered_map<long long, int> link_index_;
+  std::vector<std::vector<std::vector<int> > > nbr_;
+  std::vector<std::vector<int> > segment_first_;
+  std::vector<IloInt> traffic_first_;
+  IloIntVarArray vars_;
+  std::vector<double> values_;
+};
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_FLOW_H_
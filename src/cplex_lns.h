@@ -0,0 +1,175 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_LNS_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_LNS_H_
+
+#include "cplex_flow.h"
+#include "cplex_telemetry.h"
+#include "datastructure.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// Time limit in seconds of every sub-problem solve.
+const double kLnsTimeLimit = 5.0;
+
+// Solves the model by large neighbourhood search instead of one full solve,
+// as cplex.solve() would: a first solve of kLnsTimeLimit seconds turns the
+// MIP start the caller added, e.g., the Viterbi placement, into an incumbent.
+// Then every iteration frees the placement and routing of a few traffics,
+// fixes xtnm, ztn_n and wtuv_u_v of all other traffics to the incumbent
+// through their bounds, and re-optimizes the freed ones from the incumbent
+// for at most kLnsTimeLimit seconds. Even iterations free the traffics
+// sharing a server with a random traffic, odd ones a random subset. The
+// neighbourhoods are solved one after another on the same model, as they
+// share the ym variables and the link capacities; CPLEX parallelizes each
+// solve. If the first solve finds nothing, it falls back to a full solve with
+// the time limit the caller set. The search ends with a solve that has every
+// traffic fixed to the best solution found, and returns whether that solve
+// found it; the solution of cplex can then be read as after cplex.solve().
+// telemetry is told when the first solve, the only one on the full model,
+// is over.
+bool SolveWithLns(IloCplex cplex,
+                  const std::vector<traffic_request> &traffic_requests,
+                  int kMboxCount, const std::vector<int> &mboxType,
+                  const std::vector<int> &server4mbox, IloIntVarArray ym,
+                  IloArray<IloArray<IloIntVarArray> > xtnm,
+                  IloArray<IloArray<IloIntVarArray> > ztn_n,
+                  const FlowVariables &wtuv_u_v, int iterations,
+                  CplexTelemetry *telemetry) {
+  IloEnv env = cplex.getEnv();
+  const int kTrafficCount = traffic_requests.size();
+
+  // all integer variables, those of traffic t in [traffic_begin[t],
+  // traffic_begin[t + 1])
+  IloNumVarArray vars(env);
+  vars.add(ym);
+  std::vector<IloInt> traffic_begin(kTrafficCount + 1);
+  for (int t = 0; t < kTrafficCount; ++t) {
+    traffic_begin[t] = vars.getSize();
+    for (IloInt n = 0; n < xtnm[t].getSize(); ++n) vars.add(xtnm[t][n]);
+    for (IloInt n = 0; n < ztn_n[t].getSize(); ++n) vars.add(ztn_n[t][n]);
+    for (IloInt i = wtuv_u_v.TrafficBegin(t); i < wtuv_u_v.TrafficEnd(t);
+         ++i) {
+      vars.add(wtuv_u_v.vars()[i]);
+    }
+  }
+  traffic_begin[kTrafficCount] = vars.getSize();
+  std::vector<double> lower_bounds(vars.getSize()),
+      upper_bounds(vars.getSize());
+  for (IloInt i = 0; i < vars.getSize(); ++i) {
+    lower_bounds[i] = vars[i].getLB();
+    upper_bounds[i] = vars[i].getUB();
+  }
+
+  IloNumArray incumbent(env, vars.getSize());
+  double incumbent_cost = 0;
+  auto read_incumbent = [&] {
+    cplex.getValues(vars, incumbent);
+    for (IloInt i = 0; i < vars.getSize(); ++i) {
+      incumbent[i] = std::round(incumbent[i]);
+    }
+    incumbent_cost = cplex.getObjValue();
+  };
+  // solves with every traffic outside free fixed to the incumbent
+  auto solve_neighbourhood = [&](const std::vector<bool> &free) {
+    IloNumVarArray fixed(env);
+    IloNumArray fixed_values(env), fixed_lbs(env), fixed_ubs(env);
+    for (int t = 0; t < kTrafficCount; ++t) {
+      if (free[t]) continue;
+      for (IloInt i = traffic_begin[t]; i < traffic_begin[t + 1]; ++i) {
+        fixed.add(vars[i]);
+        fixed_values.add(incumbent[i]);
+        fixed_lbs.add(lower_bounds[i]);
+        fixed_ubs.add(upper_bounds[i]);
+      }
+    }
+    fixed.setBounds(fixed_values, fixed_values);
+    if (cplex.getNMIPStarts() > 0) {
+      cplex.deleteMIPStarts(0, cplex.getNMIPStarts());
+    }
+    cplex.addMIPStart(vars, incumbent, IloCplex::MIPStartAuto, "lns");
+    const bool kSolved = cplex.solve();
+    fixed.setBounds(fixed_lbs, fixed_ubs);
+    fixed_ubs.end();
+    fixed_lbs.end();
+    fixed_values.end();
+    fixed.end();
+    return kSolved;
+  };
+
+  const double kTimeLimit = cplex.getParam(IloCplex::TiLim);
+  cplex.setParam(IloCplex::TiLim, kLnsTimeLimit);
+  if (!cplex.solve()) {
+    incumbent.end();
+    vars.end();
+    cplex.setParam(IloCplex::TiLim, kTimeLimit);
+    return cplex.solve();
+  }
+  telemetry->FinishFullSolve(cplex);
+  read_incumbent();
+
+  const int kNeighbourhoodSize = std::max(2, kTrafficCount / 10);
+  std::mt19937 random(kTrafficCount);
+  for (int iteration = 0; kTrafficCount > 0 && iteration < iterations;
+       ++iteration) {
+    std::vector<int> order(kTrafficCount);
+    for (int t = 0; t < kTrafficCount; ++t) order[t] = t;
+    std::shuffle(order.begin(), order.end(), random);
+    std::vector<bool> free(kTrafficCount, false);
+    if (iteration % 2 == 0) {
+      // the traffics placed on the middlebox servers of order[0]
+      std::set<int> servers;
+      for (IloInt n = 0; n < xtnm[order[0]].getSize(); ++n) {
+        for (int m = 0; m < kMboxCount; ++m) {
+          IloInt i = traffic_begin[order[0]] + n * kMboxCount + m;
+          if (mboxType[m] >= 2 && incumbent[i] > 0.5) {
+            servers.insert(server4mbox[m]);
+          }
+        }
+      }
+      for (int t : order) {
+        bool touches = t == order[0];
+        for (IloInt n = 0; !touches && n < xtnm[t].getSize(); ++n) {
+          for (int m = 0; m < kMboxCount; ++m) {
+            IloInt i = traffic_begin[t] + n * kMboxCount + m;
+            if (mboxType[m] >= 2 && incumbent[i] > 0.5 &&
+                servers.count(server4mbox[m])) {
+              touches = true;
+              break;
+            }
+          }
+        }
+        if (touches) free[t] = true;
+        if (std::count(free.begin(), free.end(), true) ==
+            kNeighbourhoodSize) {
+          break;
+        }
+      }
+    } else {
+      for (int i = 0; i < kNeighbourhoodSize && i < kTrafficCount; ++i) {
+        free[order[i]] = true;
+      }
+    }
+    if (solve_neighbourhood(free) &&
+        cplex.getObjValue() < incumbent_cost - 1e-6) {
+      read_incumbent();
+      DEBUG("LNS iteration %d improved the cost to %lf\n", iteration,
+            incumbent_cost);
+    }
+  }
+
+  // leave the best solution in cplex
+  const bool kSolved =
+      solve_neighbourhood(std::vector<bool>(kTrafficCount, false));
+  cplex.setParam(IloCplex::TiLim, kTimeLimit);
+  incumbent.end();
+  vars.end();
+  return kSolved;
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_LNS_H_
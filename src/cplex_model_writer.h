@@ -0,0 +1,693 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_MODEL_WRITER_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_MODEL_WRITER_H_
+
+#include "cplex_candidates.h"
+#include "cplex_network.h"
+#include "datastructure.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <climits>
+#include <cmath>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef NO_CPLEX
+#include <ilcplex/cplex.h>
+#endif
+
+// A MILP in the form of the CPLEX callable library: bounds, types and
+// objective coefficients per column, and the rows as a CSR matrix, i.e., the
+// coefficients of row i are values[row_begin[i], row_begin[i + 1]) on the
+// columns column_index[row_begin[i], row_begin[i + 1]). Columns and rows are
+// named by family, e.g., x0, x1, ..., flow0, flow1, ..., so names cost
+// nothing to build.
+struct sparse_model {
+  std::vector<double> objective, lower_bounds, upper_bounds;
+  // 'B' for binary and 'C' for continuous columns, as CPXnewcols takes them
+  std::vector<char> column_types;
+  double objective_offset;
+  std::vector<int> row_begin, column_index;
+  std::vector<double> values;
+  // 'L', 'E' or 'G', as CPXaddrows takes them
+  std::vector<char> senses;
+  std::vector<double> rhs;
+  // (first index, name prefix) of every family, in index order
+  std::vector<std::pair<int, std::string> > column_families, row_families;
+
+  sparse_model() : objective_offset(0), row_begin(1, 0) {}
+
+  int ColumnCount() const { return objective.size(); }
+  int RowCount() const { return senses.size(); }
+  int NonzeroCount() const { return values.size(); }
+
+  // Adds count columns of a new family and returns the first one.
+  int AddColumns(const std::string &family, int count, char type, double lb,
+                 double ub) {
+    const int kFirst = ColumnCount();
+    column_families.emplace_back(kFirst, family);
+    objective.resize(kFirst + count, 0);
+    lower_bounds.resize(kFirst + count, lb);
+    upper_bounds.resize(kFirst + count, ub);
+    column_types.resize(kFirst + count, type);
+    return kFirst;
+  }
+
+  // Starts a family of rows; the rows added next belong to it.
+  void BeginRows(const std::string &family) {
+    row_families.emplace_back(RowCount(), family);
+  }
+
+  // Adds a coefficient to the row that is built; zeros are left out.
+  void AddTerm(int column, double value) {
+    if (value == 0) return;
+    column_index.push_back(column);
+    values.push_back(value);
+  }
+
+  // Closes the row that is built with its sense and right hand side.
+  void EndRow(char sense, double rhs_value) {
+    senses.push_back(sense);
+    rhs.push_back(rhs_value);
+    row_begin.push_back(values.size());
+  }
+
+  std::string Name(const std::vector<std::pair<int, std::string> > &families,
+                   int index) const {
+    auto family =
+        std::upper_bound(families.begin(), families.end(), index,
+                         [](int i, const std::pair<int, std::string> &f) {
+                           return i < f.first;
+                         }) -
+        1;
+    return family->second + std::to_string(index - family->first);
+  }
+  std::string ColumnName(int column) const {
+    return Name(column_families, column);
+  }
+  std::string RowName(int row) const { return Name(row_families, row); }
+};
+
+// Builds the linear formulation (--cplex_formulation=linear) of cplex4.h, or
+// of cplex5.h with cplex5 set, for the traffics of one timestamp, directly
+// into a sparse_model instead of through Concert expressions. It follows
+// run_cplex step by step: the same middlebox instances and pseudo switches,
+// the same columns (ym, xtnm, ztn_n, the flow variables of cplex_flow.h and
+// one SLA violation per traffic) and the same rows, including the pruning
+// and symmetry breaking that cplex_pruning and cplex_symmetry select. Rows
+// that hold by the construction of the instances, i.e., the placement
+// constraints, are left out. The logical formulation has no MPS or LP form,
+// as it uses IloIfThen and IloAbs.
+sparse_model BuildSparseCplexModel(
+    const std::vector<traffic_request> &traffic_requests, bool cplex5) {
+  sparse_model model;
+  const physical_network &network = GetPhysicalNetwork();
+  const int kInitialSwitchCount = network.switch_count;
+  const std::vector<std::vector<int> > &_nbr = network.nbr;
+
+  // servers: cplex4 deploys the ingress and egress on a special server per
+  // switch, [0, S), and the other middleboxes on [S, 2S)
+  const int kServerCount =
+      cplex5 ? kInitialSwitchCount : 2 * kInitialSwitchCount;
+  std::vector<int> switch4server(kServerCount), c_n(kServerCount, 0);
+  std::vector<bool> actual_server(kServerCount, false);
+  for (int i = 0; i < kInitialSwitchCount; ++i) {
+    const int kSwitch = network.switches[i].first;
+    const int kCpu = network.switches[i].second;
+    switch4server[i] = i;
+    if (cplex5) {
+      c_n[kSwitch] = kCpu;
+      actual_server[kSwitch] = kCpu > 0;
+    } else {
+      switch4server[i + kInitialSwitchCount] = i;
+      c_n[kSwitch + kInitialSwitchCount] = kCpu;
+      actual_server[kSwitch + kInitialSwitchCount] = kCpu > 0;
+    }
+  }
+  auto deployable = [&](int p, int _n) {
+    if (cplex5) return true;
+    return (p < 2) == (_n < kInitialSwitchCount);
+  };
+
+  // middlebox instances
+  const int kMboxTypes = middleboxes.size() + 2;
+  double total_bw = 0.0;
+  for (const traffic_request &tr : traffic_requests) {
+    total_bw += tr.min_bandwidth;
+  }
+  int kMboxCount = 0;
+  std::vector<int> server4mbox, mboxType;
+  std::vector<std::vector<int> > mbox4server(kServerCount);
+  for (int p = 0; p < kMboxTypes; ++p) {
+    for (int _n = 0; _n < kServerCount; ++_n) {
+      if (!deployable(p, _n)) continue;
+      int mcount = 1;
+      if (p >= 2) {
+        mcount = std::min(
+            floor(c_n[_n] * 1.0 / middleboxes[p - 2].cpu_requirement),
+            ceil(total_bw * 1.0 / middleboxes[p - 2].processing_capacity));
+      }
+      for (int i = 0; i < mcount; ++i) {
+        server4mbox.push_back(_n);
+        mboxType.push_back(p);
+        mbox4server[_n].push_back(kMboxCount + i);
+      }
+      kMboxCount += mcount;
+    }
+  }
+
+  // the switches: cplex4 attaches every instance to a pseudo switch of its
+  // own, in server order
+  int kSwitchCount = kInitialSwitchCount;
+  std::vector<std::vector<int> > __nbr(_nbr);
+  std::vector<int> switch4mbox(kMboxCount);
+  if (cplex5) {
+    for (int m = 0; m < kMboxCount; ++m) {
+      switch4mbox[m] = switch4server[server4mbox[m]];
+    }
+  } else {
+    kSwitchCount += kMboxCount;
+    __nbr.resize(kSwitchCount);
+    int seed = kInitialSwitchCount;
+    for (int _n = 0; _n < kServerCount; ++_n) {
+      for (int m : mbox4server[_n]) {
+        const int _u = switch4server[_n], _v = seed++;
+        __nbr[_u].push_back(_v);
+        __nbr[_v].push_back(_u);
+        switch4mbox[m] = _v;
+      }
+    }
+  }
+  std::vector<std::vector<int> > mbox4switch(kSwitchCount);
+  for (int m = 0; m < kMboxCount; ++m) {
+    mbox4switch[switch4mbox[m]].push_back(m);
+  }
+  auto link_bandwidth = [&](int _u, int _v) -> long {
+    if (_u >= kInitialSwitchCount || _v >= kInitialSwitchCount) {
+      return INT_MAX;
+    }
+    return network.beta[_u][_v];
+  };
+
+  // the logical links of the traffics, as in run_cplex
+  const int kTrafficCount = traffic_requests.size();
+  std::vector<int> trafficNodeCount(kTrafficCount);
+  std::vector<std::vector<int> > trafficNodeType(kTrafficCount);
+  std::vector<std::vector<std::vector<int> > > nbr(kTrafficCount);
+  int total_node_count = 0;
+  for (int t = 0; t < kTrafficCount; ++t) {
+    const std::vector<int> &chain = traffic_requests[t].middlebox_sequence;
+    trafficNodeCount[t] = chain.size() + 2;
+    total_node_count += trafficNodeCount[t];
+    trafficNodeType[t].push_back(0);
+    for (int p : chain) trafficNodeType[t].push_back(p + 2);
+    trafficNodeType[t].push_back(1);
+    nbr[t].push_back(std::vector<int>(1, 1));
+    for (int i = 0; i < chain.size(); ++i) {
+      nbr[t].push_back(std::vector<int>{i, i + 2});
+    }
+    nbr[t].push_back(std::vector<int>(1, chain.size()));
+  }
+
+  // columns
+  const int kYm = model.AddColumns("y", kMboxCount, 'B', 0, 1);
+  // the nodes of traffic t are [node_first[t], node_first[t + 1])
+  std::vector<int> node_first(kTrafficCount + 1, 0);
+  for (int t = 0; t < kTrafficCount; ++t) {
+    node_first[t + 1] = node_first[t] + trafficNodeCount[t];
+  }
+  const int kXtnm =
+      model.AddColumns("x", total_node_count * kMboxCount, 'B', 0, 1);
+  auto xtnm = [&](int t, int n, int m) {
+    return kXtnm + (node_first[t] + n) * kMboxCount + m;
+  };
+  const int kZtn_n =
+      model.AddColumns("z", total_node_count * kSwitchCount, 'B', 0, 1);
+  auto ztn_n = [&](int t, int n, int _s) {
+    return kZtn_n + (node_first[t] + n) * kSwitchCount + _s;
+  };
+  // the flow variables in the order of FlowVariables
+  std::unordered_map<long long, int> link_index;
+  for (int _u = 0; _u < kSwitchCount; ++_u) {
+    for (int _v : __nbr[_u]) {
+      link_index.emplace(static_cast<long long>(_u) * kSwitchCount + _v,
+                         link_index.size());
+    }
+    if (cplex5) {
+      link_index.emplace(static_cast<long long>(_u) * kSwitchCount + _u,
+                         link_index.size());
+    }
+  }
+  const int kLinkCount = link_index.size();
+  std::vector<std::vector<int> > segment_first(kTrafficCount);
+  int segment_count = 0;
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      segment_first[t].push_back(segment_count);
+      segment_count += nbr[t][n].size();
+    }
+  }
+  const int kWtuv =
+      model.AddColumns("w", segment_count * kLinkCount, 'B', 0, 1);
+  auto wtuv_u_v = [&](int t, int n1, int n2, int _u, int _v) {
+    const int kSegment = segment_first[t][n1] + (n1 > 0 && n2 > n1 ? 1 : 0);
+    auto it = link_index.find(static_cast<long long>(_u) * kSwitchCount + _v);
+    assert(it != link_index.end());
+    return kWtuv + kSegment * kLinkCount + it->second;
+  };
+  const int kViolation = model.AddColumns("violation", kTrafficCount, 'C', 0,
+                                          INFINITY);
+
+  // the bounds of xtnm
+  std::vector<std::vector<std::vector<char> > > candidates;
+  if (cplex_pruning != "off") {
+    candidates = ComputeCandidateInstances(
+        traffic_requests, kMboxCount, mboxType, server4mbox,
+        switch4server.data(), cplex5 ? 0 : 1000, cplex_pruning == "sla");
+  }
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      for (int m = 0; m < kMboxCount; ++m) {
+        if (mboxType[m] != trafficNodeType[t][n] ||
+            (!candidates.empty() && !candidates[t][n][m])) {
+          model.upper_bounds[xtnm(t, n, m)] = 0;
+        }
+      }
+    }
+  }
+
+  // physical server capacity constraint
+  model.BeginRows("server_capacity");
+  for (int _n = 0; _n < kServerCount; ++_n) {
+    for (int m : mbox4server[_n]) {
+      if (mboxType[m] >= 2) {
+        model.AddTerm(kYm + m, middleboxes[mboxType[m] - 2].cpu_requirement);
+      }
+    }
+    model.EndRow('L', c_n[_n]);
+  }
+
+  // symmetry breaking among the instances of a type on a server
+  if (cplex_symmetry != "off") {
+    model.BeginRows("symmetry");
+    for (int m = 0; m + 1 < kMboxCount; ++m) {
+      if (mboxType[m] < 2 || mboxType[m] != mboxType[m + 1] ||
+          server4mbox[m] != server4mbox[m + 1]) {
+        continue;
+      }
+      model.AddTerm(kYm + m, 1);
+      model.AddTerm(kYm + m + 1, -1);
+      model.EndRow('G', 0);
+      if (cplex_symmetry != "load") continue;
+      for (int t = 0; t < kTrafficCount; ++t) {
+        const int kBandwidth = traffic_requests[t].min_bandwidth;
+        for (int n = 0; n < trafficNodeCount[t]; ++n) {
+          model.AddTerm(xtnm(t, n, m), kBandwidth);
+          model.AddTerm(xtnm(t, n, m + 1), -kBandwidth);
+        }
+      }
+      model.EndRow('G', 0);
+    }
+  }
+
+  // a middlebox with traffic is active, one row per node that may use it
+  model.BeginRows("active");
+  for (int m = 0; m < kMboxCount; ++m) {
+    for (int t = 0; t < kTrafficCount; ++t) {
+      for (int n = 0; n < trafficNodeCount[t]; ++n) {
+        if (model.upper_bounds[xtnm(t, n, m)] == 0) continue;
+        model.AddTerm(xtnm(t, n, m), 1);
+        model.AddTerm(kYm + m, -1);
+        model.EndRow('L', 0);
+      }
+    }
+  }
+
+  // ztn_n follows xtnm
+  model.BeginRows("node_switch");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      for (int m = 0; m < kMboxCount; ++m) {
+        model.AddTerm(xtnm(t, n, m), 1);
+        model.AddTerm(ztn_n(t, n, switch4mbox[m]), -1);
+        model.EndRow('L', 0);
+      }
+    }
+  }
+  model.BeginRows("switch_node");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      for (int _s = 0; _s < kSwitchCount; ++_s) {
+        model.AddTerm(ztn_n(t, n, _s), 1);
+        for (int m : mbox4switch[_s]) model.AddTerm(xtnm(t, n, m), -1);
+        model.EndRow('L', 0);
+      }
+    }
+  }
+
+  // ingress & egress constraint, _z_s_n[s][_n] being 1 iff server _n is
+  // attached to switch s
+  model.BeginRows("ingress_egress");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    const int kLast = trafficNodeCount[t] - 1;
+    for (int m = 0; m < kMboxCount; ++m) {
+      const int kSwitch = switch4server[server4mbox[m]];
+      model.AddTerm(xtnm(t, 0, m), 1);
+      model.AddTerm(kYm + m, -(kSwitch == traffic_requests[t].source));
+      model.EndRow('L', 0);
+      model.AddTerm(xtnm(t, kLast, m), 1);
+      model.AddTerm(kYm + m, -(kSwitch == traffic_requests[t].destination));
+      model.EndRow('L', 0);
+    }
+  }
+
+  // physical link capacity constraint
+  model.BeginRows("link_capacity");
+  for (int _u = 0; _u < kSwitchCount; ++_u) {
+    for (int _v : __nbr[_u]) {
+      if (_u >= _v) continue;
+      for (int t = 0; t < kTrafficCount; ++t) {
+        const int kBandwidth = traffic_requests[t].min_bandwidth;
+        for (int n1 = 0; n1 + 1 < trafficNodeCount[t]; ++n1) {
+          model.AddTerm(wtuv_u_v(t, n1, n1 + 1, _u, _v), kBandwidth);
+          model.AddTerm(wtuv_u_v(t, n1, n1 + 1, _v, _u), kBandwidth);
+        }
+      }
+      model.EndRow('L', link_bandwidth(_u, _v));
+    }
+  }
+
+  // flow constraint, one family of rows after another
+  model.BeginRows("flow");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n1 = 0, n2 = 1; n2 < trafficNodeCount[t]; ++n1, ++n2) {
+      for (int _u = 0; _u < kSwitchCount; ++_u) {
+        for (int _v : __nbr[_u]) {
+          model.AddTerm(wtuv_u_v(t, n1, n2, _u, _v), 1);
+          model.AddTerm(wtuv_u_v(t, n1, n2, _v, _u), -1);
+        }
+        model.AddTerm(ztn_n(t, n1, _u), -1);
+        model.AddTerm(ztn_n(t, n2, _u), 1);
+        model.EndRow('E', 0);
+      }
+    }
+  }
+  model.BeginRows("one_direction");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n1 = 0, n2 = 1; n2 < trafficNodeCount[t]; ++n1, ++n2) {
+      for (int _u = 0; _u < kSwitchCount; ++_u) {
+        for (int _v : __nbr[_u]) {
+          if (_u >= _v) continue;
+          model.AddTerm(wtuv_u_v(t, n1, n2, _u, _v), 1);
+          model.AddTerm(wtuv_u_v(t, n1, n2, _v, _u), 1);
+          model.EndRow('L', 1);
+        }
+      }
+    }
+  }
+  if (cplex5) {
+    // consecutive middleboxes attached to the same switch
+    model.BeginRows("self_loop");
+    for (int t = 0; t < kTrafficCount; ++t) {
+      for (int n1 = 0, n2 = 1; n2 < trafficNodeCount[t]; ++n1, ++n2) {
+        for (int _u = 0; _u < kSwitchCount; ++_u) {
+          model.AddTerm(wtuv_u_v(t, n1, n2, _u, _u), 1);
+          model.AddTerm(ztn_n(t, n1, _u), -1);
+          model.AddTerm(ztn_n(t, n2, _u), -1);
+          model.EndRow('G', -1);
+        }
+      }
+    }
+  }
+
+  // every traffic link must be embedded, the sum > 0 of run_cplex over
+  // binaries
+  model.BeginRows("embedded");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n1 = 0; n1 < trafficNodeCount[t]; ++n1) {
+      for (int n2 : nbr[t][n1]) {
+        for (int _u = 0; _u < kSwitchCount; ++_u) {
+          for (int _v : __nbr[_u]) {
+            model.AddTerm(wtuv_u_v(t, n1, n2, _u, _v), 1);
+          }
+          if (cplex5) model.AddTerm(wtuv_u_v(t, n1, n2, _u, _u), 1);
+        }
+        model.EndRow('G', 1);
+      }
+    }
+  }
+  if (cplex5) {
+    // at most one self-loop for a link without normal edges
+    model.BeginRows("self_loops");
+    for (int t = 0; t < kTrafficCount; ++t) {
+      for (int n1 = 0; n1 < trafficNodeCount[t]; ++n1) {
+        for (int n2 : nbr[t][n1]) {
+          for (int _u = 0; _u < kSwitchCount; ++_u) {
+            for (int _v : __nbr[_u]) {
+              model.AddTerm(wtuv_u_v(t, n1, n2, _u, _v), -kSwitchCount);
+            }
+            model.AddTerm(wtuv_u_v(t, n1, n2, _u, _u), 1);
+          }
+          model.EndRow('L', 1);
+        }
+      }
+    }
+  }
+
+  // middlebox processing capacity constraint
+  model.BeginRows("processing_capacity");
+  for (int m = 0; m < kMboxCount; ++m) {
+    if (mboxType[m] < 2) continue;
+    for (int t = 0; t < kTrafficCount; ++t) {
+      for (int n = 0; n < trafficNodeCount[t]; ++n) {
+        model.AddTerm(xtnm(t, n, m), traffic_requests[t].min_bandwidth);
+      }
+    }
+    model.EndRow('L', middleboxes[mboxType[m] - 2].processing_capacity +
+                          (cplex5 ? 0 : 1000));
+  }
+
+  // every traffic node should be embedded
+  model.BeginRows("placed");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      for (int m = 0; m < kMboxCount; ++m) model.AddTerm(xtnm(t, n, m), 1);
+      model.EndRow('E', 1);
+    }
+  }
+
+  // objective: deployment cost, with D_m truncated as in its IloIntArray
+  for (int m = 0; m < kMboxCount; ++m) {
+    if (mboxType[m] >= 2) {
+      model.objective[kYm + m] +=
+          static_cast<long>(middleboxes[mboxType[m] - 2].deployment_cost);
+    }
+  }
+  // energy cost, the idle part is a constant
+  const double kDurationHours =
+      traffic_requests.empty() ? 0
+                               : traffic_requests[0].duration / (60.0 * 60.0);
+  const double kCoreEnergy = (SERVER_PEAK_ENERGY - SERVER_IDLE_ENERGY) /
+                             NUM_CORES_PER_SERVER * kDurationHours *
+                             PER_UNIT_ENERGY_PRICE;
+  for (int _n = 0; _n < kServerCount; ++_n) {
+    if (!actual_server[_n]) continue;
+    model.objective_offset +=
+        SERVER_IDLE_ENERGY * kDurationHours * PER_UNIT_ENERGY_PRICE;
+    for (int m : mbox4server[_n]) {
+      if (mboxType[m] >= 2) {
+        model.objective[kYm + m] +=
+            kCoreEnergy * middleboxes[mboxType[m] - 2].cpu_requirement;
+      }
+    }
+  }
+  // forwarding cost and SLA violation over the physical links
+  model.BeginRows("violation");
+  for (int t = 0; t < kTrafficCount; ++t) {
+    const traffic_request &tr = traffic_requests[t];
+    const double kHopCost = 0.001 * tr.min_bandwidth * per_bit_transit_cost *
+                            tr.duration;
+    for (int n1 = 0, n2 = 1; n2 < trafficNodeCount[t]; ++n1, ++n2) {
+      for (int _u = 0; _u < kInitialSwitchCount; ++_u) {
+        for (int _v : _nbr[_u]) {
+          if (_u >= _v) continue;
+          model.objective[wtuv_u_v(t, n1, n2, _u, _v)] += kHopCost;
+          model.objective[wtuv_u_v(t, n1, n2, _v, _u)] += kHopCost;
+          model.AddTerm(wtuv_u_v(t, n1, n2, _u, _v),
+                        -network.delta[_u][_v]);
+          model.AddTerm(wtuv_u_v(t, n1, n2, _v, _u),
+                        -network.delta[_v][_u]);
+        }
+      }
+    }
+    for (int n = 0; n < trafficNodeCount[t]; ++n) {
+      for (int m = 0; m < kMboxCount; ++m) {
+        if (mboxType[m] >= 2) {
+          model.AddTerm(xtnm(t, n, m),
+                        -middleboxes[mboxType[m] - 2].processing_delay);
+        }
+      }
+    }
+    model.AddTerm(kViolation + t, 1);
+    model.EndRow('G', -tr.max_delay);
+    model.objective[kViolation + t] += tr.delay_penalty;
+  }
+
+  // objective >= 0
+  model.BeginRows("nonnegative_opex");
+  for (int i = 0; i < model.ColumnCount(); ++i) {
+    model.AddTerm(i, model.objective[i]);
+  }
+  model.EndRow('G', -model.objective_offset);
+  return model;
+}
+
+// Writes model in MPS format, with the names separated by spaces (free MPS)
+// as the names are longer than 8 characters. The objective row is opex; its
+// right hand side is minus the constant of the objective, as CPLEX reads it.
+void WriteMps(const sparse_model &model, FILE *file) {
+  const int kColumnCount = model.ColumnCount();
+  const int kRowCount = model.RowCount();
+  // the columns of the CSR matrix
+  std::vector<int> column_begin(kColumnCount + 1, 0);
+  for (int column : model.column_index) ++column_begin[column + 1];
+  for (int i = 0; i < kColumnCount; ++i) {
+    column_begin[i + 1] += column_begin[i];
+  }
+  std::vector<int> row_index(model.NonzeroCount()), next(column_begin);
+  std::vector<double> column_values(model.NonzeroCount());
+  for (int row = 0; row < kRowCount; ++row) {
+    for (int i = model.row_begin[row]; i < model.row_begin[row + 1]; ++i) {
+      const int kPosition = next[model.column_index[i]]++;
+      row_index[kPosition] = row;
+      column_values[kPosition] = model.values[i];
+    }
+  }
+
+  fprintf(file, "NAME middleman\nROWS\n N opex\n");
+  for (int row = 0; row < kRowCount; ++row) {
+    fprintf(file, " %c %s\n", model.senses[row], model.RowName(row).c_str());
+  }
+  fprintf(file, "COLUMNS\n");
+  bool integer = false;
+  for (int column = 0; column < kColumnCount; ++column) {
+    if ((model.column_types[column] == 'B') != integer) {
+      integer = !integer;
+      fprintf(file, " MARKER 'MARKER' %s\n", integer ? "'INTORG'" : "'INTEND'");
+    }
+    const std::string kName = model.ColumnName(column);
+    if (model.objective[column] != 0) {
+      fprintf(file, " %s opex %.17g\n", kName.c_str(),
+              model.objective[column]);
+    }
+    for (int i = column_begin[column]; i < column_begin[column + 1]; ++i) {
+      fprintf(file, " %s %s %.17g\n", kName.c_str(),
+              model.RowName(row_index[i]).c_str(), column_values[i]);
+    }
+  }
+  if (integer) fprintf(file, " MARKER 'MARKER' 'INTEND'\n");
+  fprintf(file, "RHS\n");
+  if (model.objective_offset != 0) {
+    fprintf(file, " RHS opex %.17g\n", -model.objective_offset);
+  }
+  for (int row = 0; row < kRowCount; ++row) {
+    if (model.rhs[row] != 0) {
+      fprintf(file, " RHS %s %.17g\n", model.RowName(row).c_str(),
+              model.rhs[row]);
+    }
+  }
+  fprintf(file, "BOUNDS\n");
+  for (int column = 0; column < kColumnCount; ++column) {
+    const std::string kName = model.ColumnName(column);
+    const double kLb = model.lower_bounds[column];
+    const double kUb = model.upper_bounds[column];
+    if (kLb == kUb) {
+      fprintf(file, " FX BND %s %.17g\n", kName.c_str(), kLb);
+    } else if (model.column_types[column] == 'B') {
+      fprintf(file, " BV BND %s\n", kName.c_str());
+    } else {
+      if (kLb != 0) fprintf(file, " LO BND %s %.17g\n", kName.c_str(), kLb);
+      if (kUb != INFINITY) {
+        fprintf(file, " UP BND %s %.17g\n", kName.c_str(), kUb);
+      }
+    }
+  }
+  fprintf(file, "ENDATA\n");
+}
+
+// Writes model in the LP format of CPLEX.
+void WriteLp(const sparse_model &model, FILE *file) {
+  // CPLEX reads lines of at most 510 characters
+  auto write_term = [&](int count, double value, int column) {
+    fprintf(file, "%s %s %.17g %s", count > 0 && count % 4 == 0 ? "\n" : "",
+            value < 0 ? "-" : "+", std::fabs(value),
+            model.ColumnName(column).c_str());
+  };
+  fprintf(file, "Minimize\n opex:");
+  int count = 0;
+  for (int column = 0; column < model.ColumnCount(); ++column) {
+    if (model.objective[column] != 0) {
+      write_term(count++, model.objective[column], column);
+    }
+  }
+  if (model.objective_offset != 0) {
+    fprintf(file, " + %.17g", model.objective_offset);
+  }
+  fprintf(file, "\nSubject To\n");
+  for (int row = 0; row < model.RowCount(); ++row) {
+    fprintf(file, " %s:", model.RowName(row).c_str());
+    count = 0;
+    for (int i = model.row_begin[row]; i < model.row_begin[row + 1]; ++i) {
+      write_term(count++, model.values[i], model.column_index[i]);
+    }
+    if (count == 0) fprintf(file, " 0 %s", model.ColumnName(0).c_str());
+    const char kSense = model.senses[row];
+    fprintf(file, " %s %.17g\n",
+            kSense == 'L' ? "<=" : (kSense == 'G' ? ">=" : "="),
+            model.rhs[row]);
+  }
+  fprintf(file, "Bounds\n");
+  for (int column = 0; column < model.ColumnCount(); ++column) {
+    const std::string kName = model.ColumnName(column);
+    const double kLb = model.lower_bounds[column];
+    const double kUb = model.upper_bounds[column];
+    if (kLb == kUb) {
+      fprintf(file, " %s = %.17g\n", kName.c_str(), kLb);
+    } else if (model.column_types[column] != 'B') {
+      fprintf(file, " %.17g <= %s <= %s\n", kLb, kName.c_str(),
+              kUb == INFINITY ? "+inf" : std::to_string(kUb).c_str());
+    }
+  }
+  fprintf(file, "Binaries\n");
+  for (int column = 0; column < model.ColumnCount(); ++column) {
+    if (model.column_types[column] == 'B' &&
+        model.lower_bounds[column] != model.upper_bounds[column]) {
+      fprintf(file, " %s\n", model.ColumnName(column).c_str());
+    }
+  }
+  fprintf(file, "End\n");
+}
+
+#ifndef NO_CPLEX
+// Loads model into lp of the CPLEX callable library with one CPXnewcols and
+// one CPXaddrows call. Returns the status of the first call that fails, or 0.
+int LoadSparseModel(CPXCENVptr env, CPXLPptr lp, const sparse_model &model) {
+  int status = CPXchgobjsen(env, lp, CPX_MIN);
+  if (status) return status;
+  status = CPXnewcols(env, lp, model.ColumnCount(), model.objective.data(),
+                      model.lower_bounds.data(), model.upper_bounds.data(),
+                      model.column_types.data(), nullptr);
+  if (status) return status;
+  status = CPXaddrows(env, lp, 0, model.RowCount(), model.NonzeroCount(),
+                      model.rhs.data(), model.senses.data(),
+                      model.row_begin.data(), model.column_index.data(),
+                      model.values.data(), nullptr, nullptr);
+  if (status) return status;
+  return CPXchgobjoffset(env, lp, model.objective_offset);
+}
+#endif
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_MODEL_WRITER_H_
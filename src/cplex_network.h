@@ -0,0 +1,57 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_NETWORK_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_NETWORK_H_
+
+#include "datastructure.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// The part of the CPLEX models that does not depend on the traffic: the
+// switches with their CPU, the links in topology file order, and the link
+// bandwidth and delay matrices and neighbour lists built from them. It is
+// built once from the topology loaded by InitializeTopology and shared by
+// every run_cplex call, instead of every call parsing the topology file again.
+struct physical_network {
+  int switch_count;
+  // (switch, cpu) pairs in file order.
+  std::vector<std::pair<int, int> > switches;
+  std::vector<topology_edge> links;
+  matrix<long> beta;
+  matrix<int> delta;
+  std::vector<std::vector<int> > nbr;
+  long max_beta;
+  int max_delta;
+};
+
+physical_network BuildPhysicalNetwork() {
+  physical_network network;
+  network.switch_count = nodes.size();
+  for (const node &n : nodes) {
+    network.switches.emplace_back(n.node_id, n.num_cores);
+  }
+  network.links = topology_edges;
+  network.beta.Resize(network.switch_count, network.switch_count, 0);
+  network.delta.Resize(network.switch_count, network.switch_count, 0);
+  network.nbr.resize(network.switch_count);
+  network.max_beta = 0;
+  network.max_delta = 0;
+  for (const topology_edge &link : network.links) {
+    const int _u = link.source, _v = link.destination;
+    network.beta[_u][_v] = network.beta[_v][_u] = link.bandwidth;
+    network.delta[_u][_v] = network.delta[_v][_u] = link.delay;
+    network.nbr[_u].push_back(_v);
+    network.nbr[_v].push_back(_u);
+    network.max_beta = std::max(network.max_beta, network.beta[_u][_v]);
+    network.max_delta = std::max(network.max_delta, link.delay);
+  }
+  return network;
+}
+
+// Must not be called before InitializeTopology.
+inline const physical_network &GetPhysicalNetwork() {
+  static const physical_network kNetwork = BuildPhysicalNetwork();
+  return kNetwork;
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_NETWORK_H_
@@ -0,0 +1,123 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_SCHEDULER_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_SCHEDULER_H_
+
+#include "datastructure.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The requests arriving at one timestamp and the solution run_cplex (or the
+// Lagrangian engine) computed for them.
+struct cplex_timestamp {
+  int time;
+  std::vector<traffic_request> traffic_requests;
+  double opex, running_time;
+  // only computed by the Lagrangian engine; opex then only covers the
+  // traffics that were not rejected
+  double lower_bound;
+  int rejected;
+  std::vector<double> opex_breakdown;
+  std::vector<std::vector<int>> sequences;
+  std::vector<std::vector<std::pair<int, int>>> edges, all_edges;
+  std::vector<int> delays;
+  std::vector<int> utilization;
+};
+
+// Splits the requests into timestamps of consecutive requests with the same
+// arrival time.
+std::vector<cplex_timestamp> GroupByArrivalTime(
+    const std::vector<traffic_request> &traffic_requests) {
+  std::vector<cplex_timestamp> timestamps;
+  for (const traffic_request &tr : traffic_requests) {
+    if (timestamps.empty() || timestamps.back().time != tr.arrival_time) {
+      timestamps.emplace_back();
+      timestamps.back().time = tr.arrival_time;
+    }
+    timestamps.back().traffic_requests.push_back(tr);
+  }
+  return timestamps;
+}
+
+#ifndef NO_CPLEX
+void SolveCplexTimestamp(cplex_timestamp *timestamp,
+                         const std::string &topology_filename) {
+  const int kTrafficCount = timestamp->traffic_requests.size();
+  timestamp->sequences.assign(kTrafficCount, std::vector<int>());
+  timestamp->edges.assign(kTrafficCount,
+                          std::vector<std::pair<int, int>>());
+  timestamp->all_edges.assign(kTrafficCount,
+                              std::vector<std::pair<int, int>>());
+  timestamp->delays.assign(kTrafficCount, 0);
+  run_cplex(timestamp->traffic_requests, timestamp->opex,
+            timestamp->opex_breakdown, timestamp->running_time,
+            timestamp->sequences.data(), timestamp->edges,
+            timestamp->all_edges, timestamp->delays.data(),
+            timestamp->utilization, topology_filename);
+}
+#endif
+
+// Calls solve for every timestamp and passes it to write in timestamp order,
+// after which its solution is released. With more than one worker, the
+// timestamps are handed out to num_workers threads, the ones with the most
+// requests first, and an idle worker takes the next unsolved one, so a few
+// heavy timestamps do not hold back a worker with a fixed share of the trace.
+// The timestamps are independent, as every run_cplex call builds its own
+// IloEnv, and each CPLEX solve then gets its share of the cores
+// (GetWorkerCplexThreads). write is always called on the calling thread.
+void SolveCplexTimestamps(
+    std::vector<cplex_timestamp> &timestamps, int num_workers,
+    const std::function<void(cplex_timestamp *)> &solve,
+    const std::function<void(const cplex_timestamp &)> &write) {
+  const int kTimestampCount = timestamps.size();
+  if (num_workers <= 1) {
+    for (cplex_timestamp &timestamp : timestamps) {
+      solve(&timestamp);
+      write(timestamp);
+      timestamp = cplex_timestamp();
+    }
+    return;
+  }
+
+  std::vector<int> order(kTimestampCount);
+  for (int i = 0; i < kTimestampCount; ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return timestamps[a].traffic_requests.size() >
+           timestamps[b].traffic_requests.size();
+  });
+
+  std::atomic<int> next_job(0);
+  std::mutex mutex;
+  std::condition_variable solved;
+  std::vector<bool> done(kTimestampCount, false);
+  std::vector<std::thread> workers;
+  for (int w = 0; w < std::min(num_workers, kTimestampCount); ++w) {
+    workers.emplace_back([&] {
+      for (int job = next_job++; job < kTimestampCount; job = next_job++) {
+        solve(&timestamps[order[job]]);
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          done[order[job]] = true;
+        }
+        solved.notify_one();
+      }
+    });
+  }
+  for (int i = 0; i < kTimestampCount; ++i) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      solved.wait(lock, [&] { return done[i]; });
+    }
+    write(timestamps[i]);
+    timestamps[i] = cplex_timestamp();
+  }
+  for (auto &worker : workers) worker.join();
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_SCHEDULER_H_
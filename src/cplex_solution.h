@@ -0,0 +1,41 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_SOLUTION_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_SOLUTION_H_
+
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// Values of a jagged 3-D variable array, e.g., xtnm[t][n][m], in the current
+// solution. They are read with one getValues call into a flat array instead
+// of one getValue call per variable and use.
+class SolutionValues3d {
+ public:
+  SolutionValues3d(IloCplex cplex,
+                   IloArray<IloArray<IloIntVarArray> > vars) {
+    IloEnv env = cplex.getEnv();
+    IloNumVarArray flat(env);
+    offsets_.resize(vars.getSize());
+    for (IloInt i = 0; i < vars.getSize(); ++i) {
+      for (IloInt j = 0; j < vars[i].getSize(); ++j) {
+        offsets_[i].push_back(flat.getSize());
+        flat.add(vars[i][j]);
+      }
+    }
+    IloNumArray values(env, flat.getSize());
+    cplex.getValues(flat, values);
+    values_.resize(flat.getSize());
+    for (IloInt i = 0; i < flat.getSize(); ++i) values_[i] = values[i];
+    values.end();
+    flat.end();
+  }
+
+  double operator()(int i, int j, int k) const {
+    return values_[offsets_[i][j] + k];
+  }
+
+ private:
+  std::vector<std::vector<IloInt> > offsets_;
+  std::vector<double> values_;
+};
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_SOLUTION_H_
@@ -0,0 +1,45 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_SYMMETRY_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_SYMMETRY_H_
+
+#include "datastructure.h"
+
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// The instances of one middlebox type on one server are created as a run of
+// consecutive indices and are interchangeable: relabelling them, together
+// with their pseudo switches and flows, gives a solution of the same cost.
+// This adds ym[m] >= ym[m + 1] within every such run, so the solver only
+// explores the placements that activate a prefix of the run. With
+// order_load, it also adds load[m] >= load[m + 1], the load being the
+// bandwidth of the traffic nodes placed on the instance. Every solution can
+// be relabelled to satisfy both, as an instance with load is active, so the
+// optimum is unchanged.
+void AddInstanceSymmetryBreaking(
+    IloEnv env, IloModel model,
+    const std::vector<traffic_request> &traffic_requests, int kMboxCount,
+    const std::vector<int> &mboxType, const std::vector<int> &server4mbox,
+    IloIntVarArray ym, IloArray<IloArray<IloIntVarArray> > xtnm,
+    bool order_load) {
+  const int kTrafficCount = traffic_requests.size();
+  for (int m = 0; m + 1 < kMboxCount; ++m) {
+    if (mboxType[m] < 2 || mboxType[m] != mboxType[m + 1] ||
+        server4mbox[m] != server4mbox[m + 1]) {
+      continue;
+    }
+    model.add(ym[m] >= ym[m + 1]);
+    if (!order_load) continue;
+    IloExpr load_difference(env);
+    for (int t = 0; t < kTrafficCount; ++t) {
+      const int kBandwidth = traffic_requests[t].min_bandwidth;
+      for (IloInt n = 0; n < xtnm[t].getSize(); ++n) {
+        load_difference += (xtnm[t][n][m] - xtnm[t][n][m + 1]) * kBandwidth;
+      }
+    }
+    model.add(load_difference >= 0);
+    load_difference.end();
+  }
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_SYMMETRY_H_
@@ -0,0 +1,170 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_TELEMETRY_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_TELEMETRY_H_
+
+#include "datastructure.h"
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// What the callbacks of one solve observe.
+struct cplex_progress {
+  // solver time when the solve started
+  double start_time;
+  // (seconds into the solve, objective) of every new incumbent
+  std::vector<std::pair<double, double> > incumbents;
+  // best bound and seconds into the solve while still at the root node
+  double root_bound, root_time;
+  int removed_rows, removed_cols;
+  // set once the solve of the full model is over, after which the later
+  // solves of a large neighbourhood search only add incumbents
+  bool full_solve_done;
+  // the callbacks may run on several solver threads
+  std::mutex mutex;
+};
+
+ILOMIPINFOCALLBACK1(RecordMipProgress, cplex_progress *, progress) {
+  std::lock_guard<std::mutex> lock(progress->mutex);
+  const double kElapsed = getCplexTime() - progress->start_time;
+  if (getNnodes() == 0 && !progress->full_solve_done) {
+    progress->root_bound = getBestObjValue();
+    progress->root_time = kElapsed;
+  }
+  if (hasIncumbent()) {
+    const double kObjective = getIncumbentObjValue();
+    if (progress->incumbents.empty() ||
+        progress->incumbents.back().second != kObjective) {
+      progress->incumbents.emplace_back(kElapsed, kObjective);
+    }
+  }
+}
+
+ILOPRESOLVECALLBACK1(RecordPresolveProgress, cplex_progress *, progress) {
+  std::lock_guard<std::mutex> lock(progress->mutex);
+  if (progress->full_solve_done) return;
+  progress->removed_rows = getNremovedRows();
+  progress->removed_cols = getNremovedCols();
+}
+
+// Records one line per CPLEX solve in log.cplex.telemetry when
+// --cplex_telemetry is on, with the fields separated by spaces:
+//   arrival_time label traffic_count build_seconds solve_seconds
+//   root_seconds rows cols binaries removed_rows removed_cols root_bound
+//   best_bound objective gap nodes status incumbents
+// where incumbents is a comma separated list of seconds:objective, or "-".
+// Values that are not available, e.g., the objective of an infeasible model,
+// are written as nan. The model build time is measured from the creation of
+// this object to Attach, so create it before building the model. For a large
+// neighbourhood search the label gets a "-lns" suffix; see FinishFullSolve.
+class CplexTelemetry {
+ public:
+  CplexTelemetry(const std::vector<traffic_request> &traffic_requests,
+                 const std::string &label)
+      : arrival_time_(traffic_requests.empty()
+                          ? 0
+                          : traffic_requests[0].arrival_time),
+        traffic_count_(traffic_requests.size()),
+        label_(label),
+        build_start_(std::chrono::high_resolution_clock::now()),
+        build_seconds_(NAN),
+        lns_(false),
+        full_best_bound_(NAN),
+        full_nodes_(0) {
+    progress_.start_time = 0;
+    progress_.root_bound = progress_.root_time = NAN;
+    progress_.removed_rows = progress_.removed_cols = 0;
+    progress_.full_solve_done = false;
+  }
+
+  // Call right before cplex.solve().
+  void Attach(IloEnv env, IloCplex cplex) {
+    if (!use_cplex_telemetry) return;
+    build_seconds_ = std::chrono::duration<double>(
+                         std::chrono::high_resolution_clock::now() -
+                         build_start_).count();
+    progress_.start_time = cplex.getCplexTime();
+    cplex.use(RecordMipProgress(env, &progress_));
+    cplex.use(RecordPresolveProgress(env, &progress_));
+  }
+
+  // Call after the first solve of a large neighbourhood search, which still
+  // covers the full model. Its root bound, best bound, node count and
+  // presolve reductions are the ones logged, and the gap is taken against
+  // its best bound, as the later solves only see sub-models; the solve time
+  // and the incumbents cover the whole search.
+  void FinishFullSolve(IloCplex cplex) {
+    if (!use_cplex_telemetry) return;
+    std::lock_guard<std::mutex> lock(progress_.mutex);
+    progress_.full_solve_done = true;
+    lns_ = true;
+    full_best_bound_ = cplex.getBestObjValue();
+    full_nodes_ = cplex.getNnodes();
+  }
+
+  // Call after cplex.solve() returned, whether a solution was found or not,
+  // and before the environment is ended.
+  void Finish(IloCplex cplex) {
+    if (!use_cplex_telemetry) return;
+    const double kSolveSeconds = cplex.getCplexTime() - progress_.start_time;
+    const IloAlgorithm::Status kStatus = cplex.getStatus();
+    const bool kHasSolution =
+        kStatus == IloAlgorithm::Feasible || kStatus == IloAlgorithm::Optimal;
+    std::ostringstream status;
+    status << kStatus;
+    std::string incumbents;
+    for (auto &incumbent : progress_.incumbents) {
+      if (!incumbents.empty()) incumbents += ",";
+      incumbents += std::to_string(incumbent.first) + ":" +
+                    std::to_string(incumbent.second);
+    }
+    if (incumbents.empty()) incumbents = "-";
+    const double kObjective = kHasSolution ? cplex.getObjValue() : NAN;
+    double best_bound = kHasSolution ? cplex.getBestObjValue() : NAN;
+    double gap = kHasSolution ? cplex.getMIPRelativeGap() : NAN;
+    long nodes = cplex.getNnodes();
+    if (lns_) {
+      // the relative gap as CPLEX defines it
+      best_bound = full_best_bound_;
+      gap = std::fabs(best_bound - kObjective) /
+            (1e-10 + std::fabs(kObjective));
+      nodes = full_nodes_;
+    }
+    const std::string kLabel = lns_ ? label_ + "-lns" : label_;
+
+    static std::mutex log_mutex;
+    static FILE *log_file = fopen("log.cplex.telemetry", "w");
+    std::lock_guard<std::mutex> lock(log_mutex);
+    fprintf(log_file,
+            "%d %s %d %lf %lf %lf %ld %ld %ld %d %d %lf %lf %lf %lf %ld %s "
+            "%s\n",
+            arrival_time_, kLabel.c_str(), traffic_count_, build_seconds_,
+            kSolveSeconds, progress_.root_time,
+            static_cast<long>(cplex.getNrows()),
+            static_cast<long>(cplex.getNcols()),
+            static_cast<long>(cplex.getNbinVars()), progress_.removed_rows,
+            progress_.removed_cols, progress_.root_bound, best_bound,
+            kObjective, gap, nodes, status.str().c_str(), incumbents.c_str());
+    fflush(log_file);
+  }
+
+ private:
+  int arrival_time_;
+  int traffic_count_;
+  std::string label_;
+  std::chrono::high_resolution_clock::time_point build_start_;
+  double build_seconds_;
+  // set by FinishFullSolve
+  bool lns_;
+  double full_best_bound_;
+  long full_nodes_;
+  cplex_progress progress_;
+};
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_TELEMETRY_H_
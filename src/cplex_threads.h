@@ -0,0 +1,17 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_THREADS_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_THREADS_H_
+
+#include "datastructure.h"
+
+#include <algorithm>
+#include <thread>
+
+// The CPLEX thread count of one solve while --cplex_workers solves run at
+// once, so together they take about every hardware thread instead of each
+// taking the count its variant sets.
+inline int GetWorkerCplexThreads() {
+  const int kCores = std::max(1u, std::thread::hardware_concurrency());
+  return std::max(1, kCores / std::max(1, cplex_workers));
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_THREADS_H_
@@ -0,0 +1,56 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_VNF_SEARCH_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_VNF_SEARCH_H_
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// The CPLEX thread count of one is_feasible probe of SearchMaxVnf, so the
+// probes of a round share the cores instead of each taking all of them.
+// With --cplex_workers, the cores are also split among the workers: a
+// worker's other solves run next to the probes of another worker's round.
+inline int GetProbeCplexThreads() {
+  const int kCores = std::max(1u, std::thread::hardware_concurrency());
+  return std::max(1, kCores / (GetThreadPool().size() *
+                               std::max(1, cplex_workers)));
+}
+
+// Finds the smallest max_vnf in (lower_bound, upper_bound] for which
+// is_feasible(max_vnf) holds, given that feasibility is monotone in max_vnf.
+// Every round probes as many values as the thread pool has threads, spread
+// evenly over the remaining interval, so k threads narrow it (k + 1)-fold per
+// round; with one thread this is the usual bisection. As in the serial
+// search, upper_bound itself is never probed and is returned if no probe is
+// feasible. is_feasible runs on the pool and must not use it. The pool runs
+// one ParallelFor at a time, so with --cplex_workers the rounds of different
+// workers take turns instead of running at once.
+int SearchMaxVnf(int lower_bound, int upper_bound,
+                 const std::function<bool(int)> &is_feasible) {
+  ThreadPool &pool = GetThreadPool();
+  while (upper_bound - lower_bound > 1) {
+    const int kRange = upper_bound - lower_bound;
+    const int kProbeCount = std::min(pool.size(), kRange - 1);
+    std::vector<int> probes;
+    for (int i = 1; i <= kProbeCount; ++i) {
+      probes.push_back(lower_bound +
+                       (i * kRange + kProbeCount) / (kProbeCount + 1));
+    }
+    probes.erase(std::unique(probes.begin(), probes.end()), probes.end());
+    std::vector<char> feasible(probes.size());
+    pool.ParallelFor(0, probes.size(), [&](int probe_begin, int probe_end) {
+      for (int i = probe_begin; i < probe_end; ++i) {
+        feasible[i] = is_feasible(probes[i]);
+      }
+    });
+    int i = 0;
+    while (i < probes.size() && !feasible[i]) ++i;
+    if (i < probes.size()) upper_bound = probes[i];
+    if (i > 0) lower_bound = probes[i - 1];
+  }
+  return upper_bound;
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_VNF_SEARCH_H_
@@ -0,0 +1,157 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_CPLEX_WARM_START_H_
+#define MIDDLEBOX_PLACEMENT_SRC_CPLEX_WARM_START_H_
+
+#include "cplex_flow.h"
+#include "datastructure.h"
+#include "util.h"
+#include "viterbi.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <ilcplex/ilocplex.h>
+
+// Places the requests one after another with the Viterbi engine, the same
+// way the viterbi algorithm handles one timestamp, and returns the switch
+// sequence (ingress, middleboxes, egress) of every request; an empty sequence
+// means the request was rejected. The consumed resources are released before
+// returning. It must not be called from a thread pool task, as the Viterbi
+// engine uses the thread pool; calls from different threads take turns, as
+// the engine keeps the resources in globals.
+std::vector<std::vector<int> > ComputeViterbiPlacement(
+    const std::vector<traffic_request> &traffic_requests) {
+  static std::mutex viterbi_mutex;
+  std::lock_guard<std::mutex> lock(viterbi_mutex);
+  std::vector<std::vector<int> > placement;
+  for (const traffic_request &t_request : traffic_requests) {
+    std::unique_ptr<std::vector<int> > result = ViterbiCompute(t_request);
+    if (!result->empty()) UpdateResources(result.get(), t_request);
+    placement.push_back(std::move(*result));
+  }
+  ReleaseAllResources();
+  return placement;
+}
+
+// Passes a placement of the requests computed by ComputeViterbiPlacement to
+// the solver as a MIP start, so that it begins with a feasible incumbent
+// instead of solving cold. Every node of a chain takes the first instance of
+// its type on the chosen switch that still has processing capacity and is not
+// used by another node of the same traffic; each logical link is routed from
+// the switch of that instance over the shortest path to the switch of the
+// next one. The remaining arguments are the index structures of the calling
+// model. No start is added if Viterbi rejected a request or no instance is
+// left for a node.
+void AddViterbiWarmStart(IloEnv env, IloCplex cplex,
+                         const std::vector<traffic_request> &traffic_requests,
+                         const std::vector<std::vector<int> > &placement,
+                         int kMboxCount, const std::vector<int> &mboxType,
+                         const std::vector<int> &server4mbox,
+                         const int *switch4server, const int *switch4mbox,
+                         int kSwitchCount, IloIntVarArray ym,
+                         IloArray<IloArray<IloIntVarArray> > xtnm,
+                         IloArray<IloArray<IloIntVarArray> > ztn_n,
+                         const FlowVariables &wtuv_u_v) {
+  const int kTrafficCount = traffic_requests.size();
+  if (placement.size() != kTrafficCount) return;
+  const int kMboxTypes = middleboxes.size() + 2;
+
+  // instances of every (switch, middlebox type)
+  std::vector<std::vector<int> > instances(nodes.size() * kMboxTypes);
+  for (int m = 0; m < kMboxCount; ++m) {
+    instances[switch4server[server4mbox[m]] * kMboxTypes + mboxType[m]]
+        .push_back(m);
+  }
+
+  // the instance chosen for every node of every traffic
+  std::vector<std::vector<int> > mbox4node(kTrafficCount);
+  std::vector<long> load(kMboxCount, 0);
+  std::vector<bool> active(kMboxCount, false);
+  for (int t = 0; t < kTrafficCount; ++t) {
+    const traffic_request &tr = traffic_requests[t];
+    const std::vector<int> &sequence = placement[t];
+    if (sequence.empty()) {
+      DEBUG("Viterbi rejected traffic %d, solving without a warm start\n", t);
+      return;
+    }
+    const int kNodeCount = sequence.size();
+    for (int n = 0; n < kNodeCount; ++n) {
+      int p = 0;
+      if (n == kNodeCount - 1) {
+        p = 1;
+      } else if (n > 0) {
+        p = tr.middlebox_sequence[n - 1] + 2;
+      }
+      int chosen = NIL;
+      for (int m : instances[sequence[n] * kMboxTypes + p]) {
+        if (std::find(mbox4node[t].begin(), mbox4node[t].end(), m) !=
+            mbox4node[t].end()) {
+          continue;
+        }
+        if (p >= 2 && load[m] + tr.min_bandwidth >
+                          middleboxes[p - 2].processing_capacity) {
+          continue;
+        }
+        chosen = m;
+        break;
+      }
+      if (chosen == NIL) {
+        DEBUG("No instance left for node %d of traffic %d, solving without a "
+              "warm start\n", n, t);
+        return;
+      }
+      load[chosen] += tr.min_bandwidth;
+      active[chosen] = true;
+      mbox4node[t].push_back(chosen);
+    }
+  }
+
+  IloNumVarArray start_vars(env);
+  IloNumArray start_vals(env);
+  for (int m = 0; m < kMboxCount; ++m) {
+    start_vars.add(ym[m]);
+    start_vals.add(active[m] ? 1 : 0);
+  }
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n = 0; n < mbox4node[t].size(); ++n) {
+      for (int m = 0; m < kMboxCount; ++m) {
+        start_vars.add(xtnm[t][n][m]);
+        start_vals.add(mbox4node[t][n] == m ? 1 : 0);
+      }
+      for (int _s = 0; _s < kSwitchCount; ++_s) {
+        start_vars.add(ztn_n[t][n][_s]);
+        start_vals.add(switch4mbox[mbox4node[t][n]] == _s ? 1 : 0);
+      }
+    }
+  }
+  const IloNumVarArray &w = wtuv_u_v.vars();
+  IloNumArray w_vals(env, w.getSize());
+  for (IloInt i = 0; i < w.getSize(); ++i) w_vals[i] = 0;
+  for (int t = 0; t < kTrafficCount; ++t) {
+    for (int n1 = 0, n2 = 1; n2 < mbox4node[t].size(); ++n1, ++n2) {
+      const int m1 = mbox4node[t][n1], m2 = mbox4node[t][n2];
+      const int _s1 = switch4server[server4mbox[m1]];
+      const int _s2 = switch4server[server4mbox[m2]];
+      // an instance hangs off its switch in the augmented graph
+      std::vector<int> route;
+      if (switch4mbox[m1] != _s1) route.push_back(switch4mbox[m1]);
+      for (int _u : *ComputeShortestPath(_s1, _s2)) route.push_back(_u);
+      if (switch4mbox[m2] != _s2) route.push_back(switch4mbox[m2]);
+      // consecutive nodes on the same switch use its self-loop
+      if (route.size() == 1) route.push_back(route[0]);
+      for (int i = 0; i + 1 < route.size(); ++i) {
+        w_vals[wtuv_u_v.Index(t, n1, n2, route[i], route[i + 1])] = 1;
+        w_vals[wtuv_u_v.Index(t, n2, n1, route[i + 1], route[i])] = 1;
+      }
+    }
+  }
+  start_vars.add(w);
+  start_vals.add(w_vals);
+  cplex.addMIPStart(start_vars, start_vals, IloCplex::MIPStartAuto, "viterbi");
+  w_vals.end();
+  start_vals.end();
+  start_vars.end();
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_CPLEX_WARM_START_H_
@@ -1,6 +1,7 @@
 #ifndef MIDDLEBOX_PLACEMENT_SRC_DATASTRUCTURE_H_
 #define MIDDLEBOX_PLACEMENT_SRC_DATASTRUCTURE_H_
 
+#include <algorithm>
 #include <list>
 #include <string>
 #include <sstream>
@@ -11,7 +12,6 @@
 #include <stdlib.h>
 
 #define INF 99999999
-#define MAXN 1000
 #define NIL -1
 #define EPS 1e-9
 
@@ -64,6 +64,78 @@ struct middlebox_instance {
       : m_box(m_box), residual_capacity(res_cap) {}
 };
 
+// A dense matrix sized at run time and stored row-major in one contiguous
+// block. m[i][j] indexes it like a built-in two-dimensional array.
+template <typename T>
+struct matrix {
+  int num_rows, num_columns;
+  std::vector<T> data;
+  // data.data(), or memory the matrix does not own after a call to Map.
+  T *elements;
+  matrix() : num_rows(0), num_columns(0), elements(nullptr) {}
+  matrix(const matrix &other)
+      : num_rows(0), num_columns(0), elements(nullptr) {
+    *this = other;
+  }
+
+  // Copies the elements, also those of a mapped matrix, into owned storage.
+  matrix &operator=(const matrix &other) {
+    if (this == &other) return *this;
+    data.assign(other.elements,
+                other.elements +
+                    static_cast<size_t>(other.num_rows) * other.num_columns);
+    elements = data.data();
+    num_rows = other.num_rows;
+    num_columns = other.num_columns;
+    return *this;
+  }
+
+  // Changes the shape to rows x columns. Elements inside both the old and the
+  // new shape keep their values; the others are set to value.
+  void Resize(int rows, int columns, const T &value = T()) {
+    if (columns == num_columns && elements == data.data()) {
+      data.resize(static_cast<size_t>(rows) * columns, value);
+    } else {
+      std::vector<T> resized(static_cast<size_t>(rows) * columns, value);
+      for (int i = 0; i < std::min(rows, num_rows); ++i) {
+        std::copy(elements + static_cast<size_t>(i) * num_columns,
+                  elements + static_cast<size_t>(i) * num_columns +
+                      std::min(columns, num_columns),
+                  resized.begin() + static_cast<size_t>(i) * columns);
+      }
+      data.swap(resized);
+    }
+    elements = data.data();
+    num_rows = rows;
+    num_columns = columns;
+  }
+
+  // Makes the matrix a view of rows x columns elements stored at external,
+  // e.g., in a memory-mapped file that must outlive the matrix.
+  void Map(T *external, int rows, int columns) {
+    std::vector<T>().swap(data);
+    elements = external;
+    num_rows = rows;
+    num_columns = columns;
+  }
+
+  T *operator[](int row) {
+    return elements + static_cast<size_t>(row) * num_columns;
+  }
+  const T *operator[](int row) const {
+    return elements + static_cast<size_t>(row) * num_columns;
+  }
+};
+
+// Instances of one middlebox type deployed on one node.
+struct middlebox_pool {
+  // Indices into deployed_mboxes[node], in deployment order.
+  std::vector<int> instances;
+  // Largest residual capacity among the instances.
+  long max_residual_capacity;
+  middlebox_pool() : max_residual_capacity(0) {}
+};
+
 struct traffic_request {
   int arrival_time;
   int duration;
@@ -81,6 +153,7 @@ struct traffic_request {
   // Penalty for per 1ms guarantee violation.
   double delay_penalty;
   std::vector<int> middlebox_sequence;
+  traffic_request() = default;
   traffic_request(const std::string &tr_arrival_time,
                   const std::string &tr_source, const std::string &tr_dest,
                   const std::string &tr_min_bandwidth,
@@ -129,8 +202,35 @@ struct edge_endpoint {
       : u(u_ptr), bandwidth(bw), delay(del), residual_bandwidth(bw) {}
 };
 
+// A link of the topology file, in file order.
+struct topology_edge {
+  int source, destination, delay, unused;
+  long long bandwidth;
+};
+
+// CPU cores consumed on top of nodes[].residual_cores by a partial embedding
+// (e.g., a Viterbi state and its back-pointer chain). Each entry is a
+// (node_id, cores) pair; a chain deploys at most one middlebox per stage, so
+// the list is never longer than the middlebox sequence.
 struct resource {
-  std::vector<int> cpu_cores;
+  std::vector<std::pair<int, int> > used_cores;
+};
+
+// Bottleneck residual bandwidth of the shortest path between every pair of
+// nodes, and an inverted index from each directed edge to the pairs whose
+// shortest path crosses it, so that a change of one edge only touches the
+// pairs that use it. Pairs are numbered source * num_nodes + destination and
+// the directed edges of node u are edge_offset[u] + (index in graph[u]).
+struct bottleneck_matrix {
+  int num_nodes;
+  std::vector<unsigned long> residual;
+  // residual with every edge at full bandwidth, restored by ReleaseBandwidth.
+  std::vector<unsigned long> initial;
+  std::vector<int> edge_offset;
+  // The pairs crossing edge e are pairs[pair_offset[e] .. pair_offset[e + 1]).
+  std::vector<int> pair_offset;
+  std::vector<int> pairs;
+  bottleneck_matrix() : num_nodes(0) {}
 };
 
 // Statistics for each traffic embedding.
@@ -189,8 +289,11 @@ extern std::vector<middlebox> middleboxes;
 extern std::vector<traffic_request> traffic_requests;
 extern std::vector<node> nodes;
 extern std::vector<std::vector<edge_endpoint>> graph;
+extern std::vector<topology_edge> topology_edges;
 extern std::vector<double> closeness;
 extern std::vector<std::vector<middlebox_instance>> deployed_mboxes;
+// Indexed by node and then by middlebox type, the index into middleboxes.
+extern std::vector<std::vector<middlebox_pool>> mbox_pools;
 extern std::list<int> mbox_count;
 extern std::map<std::pair<int, int>, std::unique_ptr<std::vector<int>>>
     path_cache;
@@ -205,12 +308,25 @@ extern std::vector<int> num_service_points;
 extern std::vector<double> net_util;
 extern solution_statistics stats;
 extern double per_core_cost, per_bit_transit_cost;
-extern double cost[MAXN][MAXN];
-extern int pre[MAXN][MAXN];
-extern int shortest_path[MAXN][MAXN], sp_pre[MAXN][MAXN];
-extern int shortest_edge_path[MAXN][MAXN];
-extern long bw[MAXN][MAXN];
+extern matrix<int> shortest_path, sp_pre;
+extern matrix<int> shortest_edge_path;
+extern matrix<long> bw;
+extern bottleneck_matrix path_bandwidth;
 extern int max_time;
+extern int num_threads;
+extern std::string apsp_algorithm;
+extern std::string topology_cache_dir;
+extern bool use_cplex_warm_start;
+extern bool use_cplex_telemetry;
+extern bool use_cplex_lazy_links;
+extern std::string max_vnf_search;
+extern std::string cplex_formulation;
+extern std::string cplex_pruning;
+extern std::string cplex_symmetry;
+extern int cplex_lns_iterations;
+extern int cplex_workers;
+extern int lagrangian_iterations;
+extern std::string viterbi_kernel;
 extern middlebox fake_mbox;
 extern std::vector<std::vector<int>> results;
 extern std::vector<std::vector<int>> paths;
@@ -2,9 +2,14 @@
 #define MIDDLEBOX_PLACEMENT_SRC_IO_H_
 
 #include "datastructure.h"
+#include "thread_pool.h"
 #include "util.h"
 #include <algorithm>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 std::unique_ptr<std::map<std::string, std::string> > ParseArgs(int argc,
                                                                char *argv[]) {
@@ -32,6 +37,18 @@ inline int GetMiddleboxIndex(const std::string &middlebox_name) {
   return -1;  // Not found.
 }
 
+// Same as above for the name [begin, end) of a mapped file.
+inline int GetMiddleboxIndex(const char *begin, const char *end) {
+  const size_t kLength = end - begin;
+  for (int i = 0; i < middleboxes.size(); ++i) {
+    const std::string &name = middleboxes[i].middlebox_name;
+    if (name.size() == kLength && memcmp(name.data(), begin, kLength) == 0) {
+      return i;
+    }
+  }
+  return -1;  // Not found.
+}
+
 std::unique_ptr<std::vector<std::vector<std::string> > > ReadCSVFile(
     const char *filename) {
   DEBUG("[Parsing %s]\n", filename);
@@ -108,19 +125,184 @@ void PrintTrafficRequests() {
   }
 }
 
+// Parses the integer at the start of [begin, end) the way atoi does, without
+// copying the field out of the mapped file.
+inline int ParseCSVInt(const char *begin, const char *end) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+  bool negative = false;
+  if (begin < end && (*begin == '-' || *begin == '+')) {
+    negative = *begin++ == '-';
+  }
+  int value = 0;
+  for (; begin < end && *begin >= '0' && *begin <= '9'; ++begin) {
+    value = value * 10 + (*begin - '0');
+  }
+  return negative ? -value : value;
+}
+
+// Parses the decimal in [begin, end) the way atof does. A mantissa of at most
+// 2^53 scaled by at most 10^22 is exact in a double, so one multiplication or
+// division rounds correctly; anything else (more digits, larger exponents,
+// hex or inf) is copied out and handed to atof.
+inline double ParseCSVDouble(const char *begin, const char *end) {
+  static const double kPowersOfTen[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *p = begin;
+  while (p < end && (*p == ' ' || *p == '\t')) ++p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool seen_digit = false, exact = true;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p, seen_digit = true) {
+    if (mantissa == 0 && *p == '0') continue;
+    if (++digits > 19) exact = false;
+    mantissa = mantissa * 10 + (*p - '0');
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p, seen_digit = true) {
+      --exponent;
+      if (mantissa == 0 && *p == '0') continue;
+      if (++digits > 19) exact = false;
+      mantissa = mantissa * 10 + (*p - '0');
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E') && seen_digit) {
+    const char *exponent_begin = ++p;
+    if (p < end && (*p == '-' || *p == '+')) ++p;
+    if (p < end && *p >= '0' && *p <= '9') {
+      int exponent_value = 0;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        if (exponent_value < 10000) {
+          exponent_value = exponent_value * 10 + (*p - '0');
+        }
+      }
+      exponent += *exponent_begin == '-' ? -exponent_value : exponent_value;
+    }
+  }
+  if (!seen_digit || !exact || mantissa > (1ULL << 53) || exponent > 22 ||
+      exponent < -22) {
+    return atof(std::string(begin, end).c_str());
+  }
+  double value = static_cast<double>(mantissa);
+  value = exponent < 0 ? value / kPowersOfTen[-exponent]
+                       : value * kPowersOfTen[exponent];
+  return negative ? -value : value;
+}
+
+// Calls line(line_begin, line_end) for every non-empty line of [begin, end),
+// without the trailing '\r' of a CRLF file, and returns the number of lines.
+template <typename LineCallback>
+int ForEachCSVLine(const char *begin, const char *end, LineCallback line) {
+  int line_count = 0;
+  while (begin < end) {
+    const char *newline =
+        static_cast<const char *>(memchr(begin, '\n', end - begin));
+    const char *line_end = newline ? newline : end;
+    const char *next = newline ? newline + 1 : end;
+    while (line_end > begin && line_end[-1] == '\r') --line_end;
+    if (line_end > begin) {
+      line(begin, line_end);
+      ++line_count;
+    }
+    begin = next;
+  }
+  return line_count;
+}
+
+// Fills tr from one line of a traffic request file:
+// arrival,source,destination,bandwidth,max_delay,penalty[,middlebox...].
+// Like the strtok tokenizer, runs of commas count as one separator.
+void ParseTrafficRequestLine(const char *begin, const char *end,
+                             traffic_request *tr) {
+  int field = 0;
+  while (begin < end) {
+    const char *comma =
+        static_cast<const char *>(memchr(begin, ',', end - begin));
+    const char *field_end = comma ? comma : end;
+    if (field_end > begin) {
+      switch (field++) {
+        case 0: tr->arrival_time = ParseCSVInt(begin, field_end); break;
+        case 1: tr->source = ParseCSVInt(begin, field_end); break;
+        case 2: tr->destination = ParseCSVInt(begin, field_end); break;
+        case 3: tr->min_bandwidth = ParseCSVInt(begin, field_end); break;
+        case 4: tr->max_delay = ParseCSVInt(begin, field_end); break;
+        case 5: tr->delay_penalty = ParseCSVDouble(begin, field_end); break;
+        default:
+          tr->middlebox_sequence.push_back(
+              GetMiddleboxIndex(begin, field_end));
+      }
+    }
+    begin = comma ? comma + 1 : end;
+  }
+}
+
+// Reads the traffic requests straight out of the mapped file. The file is cut
+// into chunks of about kChunkSize bytes at line boundaries; one parallel pass
+// counts the lines of every chunk, so each chunk knows the index of its first
+// request, and a second pass parses the chunks into their slots of
+// traffic_requests. Lines have no length limit.
 void InitializeTrafficRequests(const char *filename) {
+  const static size_t kChunkSize = 1 << 20;
+  DEBUG("[Parsing %s]\n", filename);
   traffic_requests.clear();
-  auto csv_vector = ReadCSVFile(filename);
-  for (int i = 0; i < csv_vector->size(); ++i) {
-    std::vector<int> mbox_sequence;
-    std::vector<std::string> &row = (*csv_vector)[i];
-    for (int mbox_seq_index = 6; mbox_seq_index < row.size();
-         ++mbox_seq_index) {
-      mbox_sequence.push_back(GetMiddleboxIndex(row[mbox_seq_index]));
+  int fd = open(filename, O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    printf("Cannot read traffic request file %s\n", filename);
+    exit(1);
+  }
+  const size_t kFileSize = file_stat.st_size;
+  if (kFileSize == 0) {
+    close(fd);
+    return;
+  }
+  void *mapped = mmap(nullptr, kFileSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    printf("Cannot map traffic request file %s\n", filename);
+    exit(1);
+  }
+  madvise(mapped, kFileSize, MADV_SEQUENTIAL);
+  const char *data = static_cast<const char *>(mapped);
+
+  const int kChunkCount = (kFileSize + kChunkSize - 1) / kChunkSize;
+  std::vector<size_t> chunk_begin(kChunkCount + 1, kFileSize);
+  chunk_begin[0] = 0;
+  for (int i = 1; i < kChunkCount; ++i) {
+    const size_t kOffset = std::max(chunk_begin[i - 1], i * kChunkSize);
+    const char *newline = static_cast<const char *>(
+        memchr(data + kOffset, '\n', kFileSize - kOffset));
+    chunk_begin[i] = newline ? newline - data + 1 : kFileSize;
+  }
+
+  ThreadPool &pool = GetThreadPool();
+  std::vector<int> first_request(kChunkCount + 1, 0);
+  pool.ParallelFor(0, kChunkCount, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      first_request[i + 1] =
+          ForEachCSVLine(data + chunk_begin[i], data + chunk_begin[i + 1],
+                         [](const char *, const char *) {});
     }
-    traffic_requests.emplace_back(row[0], row[1], row[2], row[3], row[4],
-                                  row[5], mbox_sequence);
+  });
+  for (int i = 0; i < kChunkCount; ++i) {
+    first_request[i + 1] += first_request[i];
   }
+  traffic_requests.resize(first_request[kChunkCount]);
+  pool.ParallelFor(0, kChunkCount, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      traffic_request *tr = &traffic_requests[first_request[i]];
+      ForEachCSVLine(data + chunk_begin[i], data + chunk_begin[i + 1],
+                     [&tr](const char *line_begin, const char *line_end) {
+                       ParseTrafficRequestLine(line_begin, line_end, tr++);
+                     });
+    }
+  });
+  munmap(mapped, kFileSize);
+  DEBUG("Parsed %d lines\n", static_cast<int>(traffic_requests.size()));
+  if (traffic_requests.empty()) return;
+
   int last_time_stamp = max_time;
   int current_time = traffic_requests.back().arrival_time;
   for (int i = traffic_requests.size() - 1; i >= 0; --i) {
@@ -133,68 +315,302 @@ void InitializeTrafficRequests(const char *filename) {
   }
 }
 
+// Hop-count all-pairs shortest paths by Floyd-Warshall, starting from the
+// direct edges in graph. O(N^3); kept as the reference for
+// ComputeShortestPathsBFS.
+void ComputeShortestPathsFloydWarshall(int node_count) {
+  for (int i = 0; i < node_count; ++i) {
+    std::fill(shortest_path[i], shortest_path[i] + node_count, INF);
+    std::fill(shortest_edge_path[i], shortest_edge_path[i] + node_count, INF);
+    std::fill(sp_pre[i], sp_pre[i] + node_count, NIL);
+    shortest_path[i][i] = shortest_edge_path[i][i] = 0;
+  }
+  for (int i = 0; i < node_count; ++i) {
+    for (const edge_endpoint &endpoint : graph[i]) {
+      const int kNeighbor = endpoint.u->node_id;
+      shortest_edge_path[i][kNeighbor] = 1;
+      shortest_path[i][kNeighbor] = endpoint.delay;
+      sp_pre[i][kNeighbor] = i;
+    }
+  }
+  for (int k = 0; k < node_count; ++k) {
+    const int *edge_path_k = shortest_edge_path[k];
+    const int *path_k = shortest_path[k];
+    const int *pre_k = sp_pre[k];
+    for (int i = 0; i < node_count; ++i) {
+      int *edge_path_i = shortest_edge_path[i];
+      int *path_i = shortest_path[i];
+      int *pre_i = sp_pre[i];
+      for (int j = 0; j < node_count; ++j) {
+        if (i == j) continue;
+        int relaxed_cost = edge_path_i[k] + edge_path_k[j];
+        if (edge_path_i[j] > relaxed_cost) {
+          edge_path_i[j] = relaxed_cost;
+          path_i[j] = path_i[k] + path_k[j];
+          pre_i[j] = pre_k[j];
+        }
+      }
+    }
+  }
+}
+
+// Hop-count all-pairs shortest paths by one breadth-first search per source,
+// O(N * E) in total. Each search only writes the row of its source, so the
+// sources are split across the thread pool. Among paths with the same hop
+// count it keeps the one first reached in adjacency order, which may differ
+// from the one Floyd-Warshall keeps.
+void ComputeShortestPathsBFS(int node_count) {
+  GetThreadPool().ParallelFor(0, node_count, [&](int source_begin,
+                                                 int source_end) {
+    std::vector<int> queue;
+    queue.reserve(node_count);
+    for (int source = source_begin; source < source_end; ++source) {
+      int *edge_path = shortest_edge_path[source];
+      int *path = shortest_path[source];
+      int *pre = sp_pre[source];
+      std::fill(edge_path, edge_path + node_count, INF);
+      std::fill(path, path + node_count, INF);
+      std::fill(pre, pre + node_count, NIL);
+      edge_path[source] = path[source] = 0;
+      queue.clear();
+      queue.push_back(source);
+      for (int head = 0; head < queue.size(); ++head) {
+        const int kCurrent = queue[head];
+        for (const edge_endpoint &endpoint : graph[kCurrent]) {
+          const int kNext = endpoint.u->node_id;
+          if (edge_path[kNext] != INF) continue;
+          edge_path[kNext] = edge_path[kCurrent] + 1;
+          path[kNext] = path[kCurrent] + endpoint.delay;
+          pre[kNext] = kCurrent;
+          queue.push_back(kNext);
+        }
+      }
+    }
+  });
+}
+
+// Sizes the per-node state for node_count nodes and clears the graph.
+void ResizeTopology(int node_count) {
+  graph.assign(node_count, std::vector<edge_endpoint>());
+  nodes.resize(node_count);
+  deployed_mboxes.resize(node_count);
+  mbox_pools.resize(node_count);
+  bw.Resize(node_count, node_count);
+  std::fill(bw[0], bw[0] + static_cast<size_t>(node_count) * node_count, 0);
+  closeness.resize(node_count);
+}
+
+void AddTopologyEdge(const topology_edge &edge) {
+  graph[edge.source].emplace_back(&nodes[edge.destination], edge.bandwidth,
+                                  edge.delay);
+  graph[edge.destination].emplace_back(&nodes[edge.source], edge.bandwidth,
+                                       edge.delay);
+  bw[edge.source][edge.destination] = bw[edge.destination][edge.source] =
+      edge.bandwidth;
+}
+
+// A topology cache file holds everything InitializeTopology derives from a
+// topology file: the header, then the node_count (node_id, num_cores) pairs,
+// the edges, closeness, shortest_edge_path, shortest_path and sp_pre. Every
+// section starts at a multiple of 8 bytes. The file name and the header carry
+// a hash of the topology file and the APSP algorithm, so a changed topology
+// never hits a stale cache. Caching is off unless --topology_cache_dir names
+// a directory to keep the files in.
+struct topology_cache_header {
+  char magic[8];
+  unsigned long long content_hash;
+  long long node_count, edge_count;
+};
+
+const char kTopologyCacheMagic[8] = "MBTOPO1";
+
+inline size_t AlignCacheOffset(size_t offset) { return (offset + 7) & ~7UL; }
+
+struct topology_cache_layout {
+  size_t nodes, edges, closeness, edge_path, path, pre, size;
+  topology_cache_layout(long long node_count, long long edge_count) {
+    const size_t kCells = static_cast<size_t>(node_count) * node_count;
+    nodes = AlignCacheOffset(sizeof(topology_cache_header));
+    edges = AlignCacheOffset(nodes + 2 * sizeof(int) * node_count);
+    closeness = AlignCacheOffset(edges + sizeof(topology_edge) * edge_count);
+    edge_path = AlignCacheOffset(closeness + sizeof(double) * node_count);
+    path = AlignCacheOffset(edge_path + sizeof(int) * kCells);
+    pre = AlignCacheOffset(path + sizeof(int) * kCells);
+    size = pre + sizeof(int) * kCells;
+  }
+};
+
+// FNV-1a hash of the topology file followed by the APSP algorithm name.
+// Returns false if the file cannot be read.
+bool HashTopologyFile(const char *filename, unsigned long long *hash) {
+  FILE *file_ptr = fopen(filename, "rb");
+  if (!file_ptr) return false;
+  const unsigned long long kPrime = 1099511628211ULL;
+  *hash = 14695981039346656037ULL;
+  char buffer[1 << 16];
+  size_t bytes_read;
+  while ((bytes_read = fread(buffer, 1, sizeof(buffer), file_ptr)) > 0) {
+    for (size_t i = 0; i < bytes_read; ++i) {
+      *hash = (*hash ^ static_cast<unsigned char>(buffer[i])) * kPrime;
+    }
+  }
+  fclose(file_ptr);
+  for (char c : apsp_algorithm) {
+    *hash = (*hash ^ static_cast<unsigned char>(c)) * kPrime;
+  }
+  return true;
+}
+
+// <topology_cache_dir>/<topology file name>.<hash>.cache
+std::string GetTopologyCacheFilename(const char *filename,
+                                     unsigned long long hash) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%016llx.cache", hash);
+  const char *basename = strrchr(filename, '/');
+  return topology_cache_dir + "/" + (basename ? basename + 1 : filename) +
+         suffix;
+}
+
+// Maps the cache file read-only and points the shortest path matrices into
+// it. The mapping is never released, so concurrent runs on the same topology
+// share one copy in the page cache. Returns false if there is no valid cache.
+bool LoadTopologyCache(const std::string &cache_filename,
+                       unsigned long long hash) {
+  int fd = open(cache_filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      file_stat.st_size < static_cast<off_t>(sizeof(topology_cache_header))) {
+    close(fd);
+    return false;
+  }
+  void *mapped =
+      mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) return false;
+  const char *base = static_cast<const char *>(mapped);
+  const topology_cache_header *header =
+      reinterpret_cast<const topology_cache_header *>(base);
+  const topology_cache_layout kLayout(header->node_count, header->edge_count);
+  if (memcmp(header->magic, kTopologyCacheMagic, sizeof(header->magic)) ||
+      header->content_hash != hash ||
+      static_cast<size_t>(file_stat.st_size) != kLayout.size) {
+    munmap(mapped, file_stat.st_size);
+    return false;
+  }
+  DEBUG("[Loading topology cache %s]\n", cache_filename.c_str());
+  const int kNodeCount = header->node_count;
+  ResizeTopology(kNodeCount);
+  const int *node_info = reinterpret_cast<const int *>(base + kLayout.nodes);
+  for (int i = 0; i < kNodeCount; ++i) {
+    nodes[i].node_id = node_info[2 * i];
+    nodes[i].num_cores = nodes[i].residual_cores = node_info[2 * i + 1];
+  }
+  const topology_edge *edges =
+      reinterpret_cast<const topology_edge *>(base + kLayout.edges);
+  topology_edges.assign(edges, edges + header->edge_count);
+  for (const topology_edge &edge : topology_edges) AddTopologyEdge(edge);
+  const double *cached_closeness =
+      reinterpret_cast<const double *>(base + kLayout.closeness);
+  closeness.assign(cached_closeness, cached_closeness + kNodeCount);
+  int *cells = reinterpret_cast<int *>(const_cast<char *>(base));
+  shortest_edge_path.Map(cells + kLayout.edge_path / sizeof(int), kNodeCount,
+                         kNodeCount);
+  shortest_path.Map(cells + kLayout.path / sizeof(int), kNodeCount,
+                    kNodeCount);
+  sp_pre.Map(cells + kLayout.pre / sizeof(int), kNodeCount, kNodeCount);
+  return true;
+}
+
+// Writes the cache through a temporary file that is renamed into place, so
+// a concurrent reader never sees a partial cache. Returns false if it could
+// not be written; the next run then computes the topology again.
+bool WriteTopologyCache(const std::string &cache_filename,
+                        unsigned long long hash,
+                        const std::vector<topology_edge> &edges) {
+  const int kNodeCount = nodes.size();
+  const topology_cache_layout kLayout(kNodeCount, edges.size());
+  std::vector<char> contents(kLayout.size, 0);
+  topology_cache_header *header =
+      reinterpret_cast<topology_cache_header *>(contents.data());
+  memcpy(header->magic, kTopologyCacheMagic, sizeof(header->magic));
+  header->content_hash = hash;
+  header->node_count = kNodeCount;
+  header->edge_count = edges.size();
+  int *node_info = reinterpret_cast<int *>(&contents[kLayout.nodes]);
+  for (int i = 0; i < kNodeCount; ++i) {
+    node_info[2 * i] = nodes[i].node_id;
+    node_info[2 * i + 1] = nodes[i].num_cores;
+  }
+  const size_t kCellBytes =
+      sizeof(int) * static_cast<size_t>(kNodeCount) * kNodeCount;
+  memcpy(&contents[kLayout.edges], edges.data(),
+         sizeof(topology_edge) * edges.size());
+  memcpy(&contents[kLayout.closeness], closeness.data(),
+         sizeof(double) * kNodeCount);
+  memcpy(&contents[kLayout.edge_path], shortest_edge_path[0], kCellBytes);
+  memcpy(&contents[kLayout.path], shortest_path[0], kCellBytes);
+  memcpy(&contents[kLayout.pre], sp_pre[0], kCellBytes);
+  const std::string kTempFilename =
+      cache_filename + ".tmp." + std::to_string(getpid());
+  FILE *file_ptr = fopen(kTempFilename.c_str(), "wb");
+  if (!file_ptr) return false;
+  bool written =
+      fwrite(contents.data(), 1, contents.size(), file_ptr) == contents.size();
+  written = fclose(file_ptr) == 0 && written;
+  if (!written || rename(kTempFilename.c_str(), cache_filename.c_str()) != 0) {
+    unlink(kTempFilename.c_str());
+    return false;
+  }
+  return true;
+}
+
 void InitializeTopology(const char *filename) {
+  unsigned long long hash = 0;
+  std::string cache_filename;
+  if (!topology_cache_dir.empty() && HashTopologyFile(filename, &hash)) {
+    cache_filename = GetTopologyCacheFilename(filename, hash);
+    if (LoadTopologyCache(cache_filename, hash)) {
+      InitializePathBandwidth();
+      return;
+    }
+  }
   DEBUG("[Parsing %s]\n", filename);
   FILE *file_ptr = fopen(filename, "r");
   int node_count, edge_count;
   fscanf(file_ptr, "%d %d", &node_count, &edge_count);
   DEBUG(" node_count = %d, edge_count = %d\n", node_count, edge_count);
-  graph.resize(node_count);
-  nodes.resize(node_count);
-  deployed_mboxes.resize(node_count);
+  ResizeTopology(node_count);
+  shortest_path.Resize(node_count, node_count);
+  sp_pre.Resize(node_count, node_count);
+  shortest_edge_path.Resize(node_count, node_count);
   for (int i = 0; i < node_count; ++i) {
     fscanf(file_ptr, "%d %d", &nodes[i].node_id, &nodes[i].num_cores);
     nodes[i].residual_cores = nodes[i].num_cores;
-    graph[i].clear();
-    shortest_path[i][i] = 0.0;
-    shortest_edge_path[i][i] = 0;
-    bw[i][i] = 0;
-    sp_pre[i][i] = NIL;
-    for (int j = i + 1; j < node_count; j++) {
-      shortest_path[i][j] = shortest_path[j][i] = INF;
-      shortest_edge_path[i][j] = shortest_edge_path[j][i] = INF;
-      sp_pre[i][j] = sp_pre[j][i] = NIL;
-      bw[i][j] = bw[j][i] = 0;
-    }
   }
   DEBUG("nodes.size() = %u\n", nodes.size());
   for (auto &n : nodes) {
     DEBUG("%s\n", n.GetDebugString().c_str());
   }
 
+  topology_edges.resize(edge_count);
   for (int j = 0; j < edge_count; ++j) {
-    int source, destination, delay;
-    unsigned long bandwidth;
-    fscanf(file_ptr, "%d %d %lu %d", &source, &destination, &bandwidth, &delay);
-    DEBUG(" Read edge: %d %d %lu %d\n", source, destination, bandwidth, delay);
-    DEBUG(" Adding edge, %d --> %s\n", source,
-          nodes[destination].GetDebugString().c_str());
-    DEBUG(" Adding edge, %d --> %s\n", destination,
-          nodes[source].GetDebugString().c_str());
-    graph[source].emplace_back(&nodes[destination], bandwidth, delay);
-    graph[destination].emplace_back(&nodes[source], bandwidth, delay);
-    bw[source][destination] = bw[destination][source] = bandwidth;
-    shortest_edge_path[source][destination] = 1;
-    shortest_edge_path[destination][source] = 1;
-    shortest_path[source][destination] = shortest_path[destination][source] =
-        delay;
-    sp_pre[source][destination] = source;
-    sp_pre[destination][source] = destination;
+    topology_edge &edge = topology_edges[j];
+    fscanf(file_ptr, "%d %d %lld %d", &edge.source, &edge.destination,
+           &edge.bandwidth, &edge.delay);
+    DEBUG(" Read edge: %d %d %lld %d\n", edge.source, edge.destination,
+          edge.bandwidth, edge.delay);
+    DEBUG(" Adding edge, %d --> %s\n", edge.source,
+          nodes[edge.destination].GetDebugString().c_str());
+    DEBUG(" Adding edge, %d --> %s\n", edge.destination,
+          nodes[edge.source].GetDebugString().c_str());
+    AddTopologyEdge(edge);
   }
-  for (int k = 0; k < node_count; ++k) {
-    for (int i = 0; i < node_count; ++i) {
-      for (int j = 0; j < node_count; ++j) {
-        if (i == j) continue;
-        int relaxed_cost = shortest_edge_path[i][k] + shortest_edge_path[k][j];
-        if (shortest_edge_path[i][j] > relaxed_cost) {
-          shortest_edge_path[i][j] = relaxed_cost;
-          shortest_path[i][j] = shortest_path[i][k] + shortest_path[k][j];
-          sp_pre[i][j] = sp_pre[k][j];
-        }
-      }
-    }
+  if (apsp_algorithm == "floyd_warshall") {
+    ComputeShortestPathsFloydWarshall(node_count);
+  } else {
+    ComputeShortestPathsBFS(node_count);
   }
-  closeness.resize(node_count);
   for (int i = 0; i < node_count; ++i) {
     double farness = 0.0;
     for (int j = 0; j < node_count; ++j) {
@@ -205,6 +621,13 @@ void InitializeTopology(const char *filename) {
     closeness[i] = 1.0 / farness;
   }
   fclose(file_ptr);
+  if (!cache_filename.empty()) {
+    if (!WriteTopologyCache(cache_filename, hash, topology_edges)) {
+      printf("Could not write the topology cache %s\n",
+             cache_filename.c_str());
+    }
+  }
+  InitializePathBandwidth();
 }
 
 #endif  // MIDDLEBOX_PLACEMENT_SRC_IO_H_
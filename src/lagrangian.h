@@ -0,0 +1,510 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_LAGRANGIAN_H_
+#define MIDDLEBOX_PLACEMENT_SRC_LAGRANGIAN_H_
+
+#include "cplex_network.h"
+#include "cplex_scheduler.h"
+#include "datastructure.h"
+#include "thread_pool.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// A placement engine for the model of cplex4.h that needs no solver: the
+// link bandwidth and server CPU constraints are relaxed with multipliers, so
+// every traffic becomes an independent shortest path problem on a layered
+// graph (layer i: the traffic has passed i middleboxes; it moves along links
+// within a layer and places the next middlebox on the node it is at to go to
+// the next layer). The SLA penalty max(0, delay - max_delay) * delay_penalty
+// is the maximum of theta * (delay - max_delay) * delay_penalty over theta in
+// [0, 1], so it becomes additive over the links and middleboxes with one more
+// multiplier per traffic. A middlebox instance is shared by traffics up to
+// its processing capacity, so a traffic is charged the fraction
+// min_bandwidth / processing_capacity of the deployment cost and cores of
+// one. The multipliers follow subgradient steps, and every few iterations a
+// repair step places the traffics one after another within the residual
+// capacities, reusing the instances it already deployed. The value of the
+// relaxation is a lower bound on the cost of every placement, the best
+// repaired placement gives the upper bound.
+
+// Every kLagrangianRepairInterval-th iteration is followed by a repair.
+const int kLagrangianRepairInterval = 10;
+
+// The links and nodes of the topology in the form the engine uses.
+struct lagrangian_network {
+  int node_count;
+  std::vector<topology_edge> links;
+  // (neighbor, link) pairs of every node
+  std::vector<std::vector<std::pair<int, int> > > adjacency;
+  // nodes that host servers, i.e., are paid the idle energy
+  int server_count;
+};
+
+lagrangian_network BuildLagrangianNetwork() {
+  lagrangian_network network;
+  network.node_count = nodes.size();
+  network.links = topology_edges;
+  network.adjacency.resize(network.node_count);
+  for (int l = 0; l < network.links.size(); ++l) {
+    const topology_edge &link = network.links[l];
+    network.adjacency[link.source].emplace_back(link.destination, l);
+    network.adjacency[link.destination].emplace_back(link.source, l);
+  }
+  network.server_count = 0;
+  for (const node &n : nodes) network.server_count += n.num_cores > 0;
+  return network;
+}
+
+// The route of one traffic: its node sequence (source, middlebox nodes,
+// destination) as in log.cplex.sequences and the links it traverses in order.
+struct lagrangian_route {
+  std::vector<int> sequence;
+  std::vector<std::pair<int, int> > edges;
+  std::vector<int> links;
+  double cost;
+  int delay;
+};
+
+// Finds the cheapest route of tr through the layered graph, where using link
+// l costs link_cost(l) and placing middlebox stage (0-based) on node v costs
+// placement_cost(stage, v). Infinite costs mark what cannot be used. Returns
+// false if the destination cannot be reached.
+bool FindLayeredRoute(
+    const lagrangian_network &network, const traffic_request &tr,
+    const std::function<double(int)> &link_cost,
+    const std::function<double(int, int)> &placement_cost,
+    lagrangian_route *route) {
+  const int kNodeCount = network.node_count;
+  const int kStageCount = tr.middlebox_sequence.size();
+  const int kStateCount = (kStageCount + 1) * kNodeCount;
+  const double kInf = std::numeric_limits<double>::infinity();
+  std::vector<double> cost(kStateCount, kInf);
+  // the previous state and the link that led here, NIL for a placement
+  std::vector<int> pre(kStateCount, NIL), pre_link(kStateCount, NIL);
+  typedef std::pair<double, int> entry;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry> > queue;
+  cost[tr.source] = 0;
+  queue.emplace(0, tr.source);
+  const int kTarget = kStageCount * kNodeCount + tr.destination;
+  while (!queue.empty()) {
+    const entry kTop = queue.top();
+    queue.pop();
+    const int kState = kTop.second;
+    if (kTop.first > cost[kState]) continue;
+    if (kState == kTarget) break;
+    const int kStage = kState / kNodeCount, kNode = kState % kNodeCount;
+    // the search needs non-negative costs, which a negative duration (a
+    // max_time before the last arrival) would break
+    auto relax = [&](int next, double step_cost, int link) {
+      step_cost = std::max(0.0, step_cost);
+      if (cost[kState] + step_cost < cost[next]) {
+        cost[next] = cost[kState] + step_cost;
+        pre[next] = kState;
+        pre_link[next] = link;
+        queue.emplace(cost[next], next);
+      }
+    };
+    for (const std::pair<int, int> &neighbor : network.adjacency[kNode]) {
+      const double kLinkCost = link_cost(neighbor.second);
+      if (kLinkCost < kInf) {
+        relax(kStage * kNodeCount + neighbor.first, kLinkCost,
+              neighbor.second);
+      }
+    }
+    if (kStage < kStageCount) {
+      const double kPlacementCost = placement_cost(kStage, kNode);
+      if (kPlacementCost < kInf) {
+        relax(kState + kNodeCount, kPlacementCost, NIL);
+      }
+    }
+  }
+  if (cost[kTarget] == kInf) return false;
+
+  route->sequence.clear();
+  route->edges.clear();
+  route->links.clear();
+  route->cost = cost[kTarget];
+  route->delay = 0;
+  route->sequence.push_back(tr.destination);
+  for (int state = kTarget; state != tr.source; state = pre[state]) {
+    const int kPrevious = pre[state];
+    if (pre_link[state] == NIL) {
+      route->sequence.push_back(state % kNodeCount);
+      route->delay +=
+          middleboxes[tr.middlebox_sequence[kPrevious / kNodeCount]]
+              .processing_delay;
+    } else {
+      route->edges.emplace_back(kPrevious % kNodeCount, state % kNodeCount);
+      route->links.push_back(pre_link[state]);
+      route->delay += network.links[pre_link[state]].delay;
+    }
+  }
+  route->sequence.push_back(tr.source);
+  std::reverse(route->sequence.begin(), route->sequence.end());
+  std::reverse(route->edges.begin(), route->edges.end());
+  std::reverse(route->links.begin(), route->links.end());
+  return true;
+}
+
+// Energy cost of one core and the idle energy cost of all servers for the
+// duration of the traffic, as in the energy cost of the CPLEX models.
+double GetCoreEnergyCost(const traffic_request &tr) {
+  return (SERVER_PEAK_ENERGY - SERVER_IDLE_ENERGY) / NUM_CORES_PER_SERVER *
+         (tr.duration / 3600.0) * PER_UNIT_ENERGY_PRICE;
+}
+
+double GetIdleEnergyCost(const lagrangian_network &network,
+                         const traffic_request &tr) {
+  return network.server_count * SERVER_IDLE_ENERGY * (tr.duration / 3600.0) *
+         PER_UNIT_ENERGY_PRICE;
+}
+
+// A middlebox instance deployed by the repair step.
+struct lagrangian_instance {
+  int node, type;
+  long residual_capacity;
+};
+
+// A placement of all traffics within the capacities, with its cost in the
+// breakdown of the CPLEX models: deployment, energy, forwarding, penalty.
+struct lagrangian_placement {
+  std::vector<lagrangian_route> routes;
+  std::vector<bool> accepted;
+  int rejected;
+  std::vector<double> cost_breakdown;
+  double cost;
+  std::vector<int> used_cores;
+  std::vector<long> used_bandwidth;
+};
+
+// Places the traffics one after another, the ones with the most bandwidth
+// first, on the cheapest route under the current multipliers that fits in the
+// residual link bandwidth and server cores. A middlebox reuses an instance
+// the repair already deployed on the node if it has capacity left.
+lagrangian_placement RepairPlacement(
+    const lagrangian_network &network,
+    const std::vector<traffic_request> &traffic_requests,
+    const std::vector<double> &link_price,
+    const std::vector<double> &cpu_price,
+    const std::vector<double> &sla_weight) {
+  const int kTrafficCount = traffic_requests.size();
+  const double kInf = std::numeric_limits<double>::infinity();
+  lagrangian_placement placement;
+  placement.routes.resize(kTrafficCount);
+  placement.accepted.assign(kTrafficCount, false);
+  placement.rejected = 0;
+  placement.used_cores.assign(network.node_count, 0);
+  placement.used_bandwidth.assign(network.links.size(), 0);
+  std::vector<lagrangian_instance> instances;
+
+  std::vector<int> order(kTrafficCount);
+  for (int t = 0; t < kTrafficCount; ++t) order[t] = t;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return traffic_requests[a].min_bandwidth >
+           traffic_requests[b].min_bandwidth;
+  });
+  double deployment_cost = 0, forwarding_cost = 0, penalty = 0;
+  int used_cores = 0;
+  for (int t : order) {
+    const traffic_request &tr = traffic_requests[t];
+    const double kHopCost = GetTransitCostForHops(1, tr);
+    const double kSla = sla_weight[t] * tr.delay_penalty;
+    const double kCoreCost = GetCoreEnergyCost(tr);
+    auto find_instance = [&](int node, int type) {
+      for (int i = 0; i < instances.size(); ++i) {
+        if (instances[i].node == node && instances[i].type == type &&
+            instances[i].residual_capacity >= tr.min_bandwidth) {
+          return i;
+        }
+      }
+      return static_cast<int>(NIL);
+    };
+    auto link_cost = [&](int l) {
+      if (network.links[l].bandwidth - placement.used_bandwidth[l] <
+          tr.min_bandwidth) {
+        return kInf;
+      }
+      return kHopCost + link_price[l] * tr.min_bandwidth +
+             kSla * network.links[l].delay;
+    };
+    auto placement_cost = [&](int stage, int v) {
+      const middlebox &m_box = middleboxes[tr.middlebox_sequence[stage]];
+      const double kDelayCost = kSla * m_box.processing_delay;
+      if (find_instance(v, tr.middlebox_sequence[stage]) != NIL) {
+        return kDelayCost;
+      }
+      if (m_box.processing_capacity < tr.min_bandwidth ||
+          nodes[v].num_cores - placement.used_cores[v] <
+              m_box.cpu_requirement) {
+        return kInf;
+      }
+      return m_box.deployment_cost +
+             (kCoreCost + cpu_price[v]) * m_box.cpu_requirement + kDelayCost;
+    };
+    lagrangian_route &route = placement.routes[t];
+    if (!FindLayeredRoute(network, tr, link_cost, placement_cost, &route)) {
+      ++placement.rejected;
+      continue;
+    }
+    // a route may use a link or node more than once, which the search does
+    // not see, so it is checked before committing
+    std::vector<long> link_use(network.links.size(), 0);
+    bool fits = true;
+    for (int l : route.links) {
+      link_use[l] += tr.min_bandwidth;
+      if (network.links[l].bandwidth - placement.used_bandwidth[l] <
+          link_use[l]) {
+        fits = false;
+      }
+    }
+    std::vector<int> reused(route.sequence.size(), NIL);
+    std::vector<int> core_use(network.node_count, 0);
+    for (int stage = 0; fits && stage + 2 < route.sequence.size(); ++stage) {
+      const int kNode = route.sequence[stage + 1];
+      const int kType = tr.middlebox_sequence[stage];
+      reused[stage] = find_instance(kNode, kType);
+      if (reused[stage] != NIL) {
+        // an instance serves a traffic once
+        instances[reused[stage]].residual_capacity -= tr.min_bandwidth;
+        continue;
+      }
+      core_use[kNode] += middleboxes[kType].cpu_requirement;
+      if (nodes[kNode].num_cores - placement.used_cores[kNode] <
+          core_use[kNode]) {
+        fits = false;
+      }
+    }
+    for (int stage = 0; stage + 2 < route.sequence.size(); ++stage) {
+      if (reused[stage] != NIL) {
+        instances[reused[stage]].residual_capacity += tr.min_bandwidth;
+      }
+    }
+    if (!fits) {
+      ++placement.rejected;
+      continue;
+    }
+
+    placement.accepted[t] = true;
+    for (int l : route.links) {
+      placement.used_bandwidth[l] += tr.min_bandwidth;
+      forwarding_cost += kHopCost;
+    }
+    for (int stage = 0; stage + 2 < route.sequence.size(); ++stage) {
+      const int kNode = route.sequence[stage + 1];
+      const int kType = tr.middlebox_sequence[stage];
+      const middlebox &m_box = middleboxes[kType];
+      const int kInstance = find_instance(kNode, kType);
+      if (kInstance != NIL) {
+        instances[kInstance].residual_capacity -= tr.min_bandwidth;
+        continue;
+      }
+      instances.push_back(
+          {kNode, kType, m_box.processing_capacity - tr.min_bandwidth});
+      placement.used_cores[kNode] += m_box.cpu_requirement;
+      used_cores += m_box.cpu_requirement;
+      deployment_cost += m_box.deployment_cost;
+    }
+    if (route.delay > tr.max_delay) {
+      penalty += (route.delay - tr.max_delay) * tr.delay_penalty;
+    }
+  }
+
+  const traffic_request &first = traffic_requests[0];
+  const double kEnergyCost = GetIdleEnergyCost(network, first) +
+                             used_cores * GetCoreEnergyCost(first);
+  placement.cost_breakdown = {deployment_cost, kEnergyCost, forwarding_cost,
+                              penalty};
+  placement.cost = deployment_cost + kEnergyCost + forwarding_cost + penalty;
+  return placement;
+}
+
+// Solves one timestamp with the Lagrangian engine and fills it like
+// run_cplex does; the lower bound is stored in timestamp->lower_bound. The
+// traffics of a timestamp share its duration, as in the CPLEX models.
+void SolveLagrangianTimestamp(cplex_timestamp *timestamp) {
+  static const lagrangian_network kNetwork = BuildLagrangianNetwork();
+  auto start_time = std::chrono::high_resolution_clock::now();
+  const std::vector<traffic_request> &traffic_requests =
+      timestamp->traffic_requests;
+  const int kTrafficCount = traffic_requests.size();
+  const int kLinkCount = kNetwork.links.size();
+  const int kNodeCount = kNetwork.node_count;
+  const double kInf = std::numeric_limits<double>::infinity();
+
+  std::vector<double> link_price(kLinkCount, 0), cpu_price(kNodeCount, 0);
+  std::vector<double> sla_weight(kTrafficCount, 0);
+  std::vector<lagrangian_route> routes(kTrafficCount);
+  std::vector<char> routed(kTrafficCount);
+  double lower_bound = -kInf;
+  // the repair of the initial, all-zero multipliers
+  lagrangian_placement best = RepairPlacement(
+      kNetwork, traffic_requests, link_price, cpu_price, sla_weight);
+  double step_scale = 2.0;
+  int iterations_without_improvement = 0;
+  const double kIdleCost = GetIdleEnergyCost(kNetwork, traffic_requests[0]);
+
+  for (int iteration = 0; iteration < lagrangian_iterations; ++iteration) {
+    // the relaxed problem, one traffic at a time
+    GetThreadPool().ParallelFor(0, kTrafficCount, [&](int begin, int end) {
+      for (int t = begin; t < end; ++t) {
+        const traffic_request &tr = traffic_requests[t];
+        const double kHopCost = GetTransitCostForHops(1, tr);
+        const double kSla = sla_weight[t] * tr.delay_penalty;
+        const double kCoreCost = GetCoreEnergyCost(tr);
+        auto link_cost = [&](int l) {
+          return kHopCost + link_price[l] * tr.min_bandwidth +
+                 kSla * kNetwork.links[l].delay;
+        };
+        auto placement_cost = [&](int stage, int v) {
+          const middlebox &m_box = middleboxes[tr.middlebox_sequence[stage]];
+          if (m_box.processing_capacity < tr.min_bandwidth ||
+              nodes[v].num_cores < m_box.cpu_requirement) {
+            return kInf;
+          }
+          const double kShare =
+              1.0 * tr.min_bandwidth / m_box.processing_capacity;
+          return (m_box.deployment_cost +
+                  (kCoreCost + cpu_price[v]) * m_box.cpu_requirement) *
+                     kShare +
+                 kSla * m_box.processing_delay;
+        };
+        routed[t] =
+            FindLayeredRoute(kNetwork, tr, link_cost, placement_cost,
+                             &routes[t]);
+      }
+    });
+
+    // the value of the relaxation and its subgradient
+    double value = kIdleCost;
+    std::vector<double> link_gradient(kLinkCount), cpu_gradient(kNodeCount);
+    std::vector<double> sla_gradient(kTrafficCount, 0);
+    for (int l = 0; l < kLinkCount; ++l) {
+      link_gradient[l] = -kNetwork.links[l].bandwidth;
+      value -= link_price[l] * kNetwork.links[l].bandwidth;
+    }
+    for (int v = 0; v < kNodeCount; ++v) {
+      cpu_gradient[v] = -nodes[v].num_cores;
+      value -= cpu_price[v] * nodes[v].num_cores;
+    }
+    bool all_routed = true;
+    for (int t = 0; t < kTrafficCount; ++t) {
+      if (!routed[t]) {
+        all_routed = false;
+        continue;
+      }
+      const traffic_request &tr = traffic_requests[t];
+      value += routes[t].cost - sla_weight[t] * tr.delay_penalty *
+                                    tr.max_delay;
+      for (int l : routes[t].links) link_gradient[l] += tr.min_bandwidth;
+      for (int stage = 0; stage + 2 < routes[t].sequence.size(); ++stage) {
+        const middlebox &m_box = middleboxes[tr.middlebox_sequence[stage]];
+        cpu_gradient[routes[t].sequence[stage + 1]] +=
+            1.0 * m_box.cpu_requirement * tr.min_bandwidth /
+            m_box.processing_capacity;
+      }
+      sla_gradient[t] = 1.0 * tr.delay_penalty *
+                        (routes[t].delay - tr.max_delay);
+    }
+    // a traffic that cannot be routed even without capacities is rejected
+    // by every placement, so there is no bound on a full placement
+    if (all_routed && value > lower_bound) {
+      lower_bound = value;
+      iterations_without_improvement = 0;
+    } else if (++iterations_without_improvement >= 10) {
+      step_scale /= 2;
+      iterations_without_improvement = 0;
+    }
+
+    if (iteration > 0 && (iteration % kLagrangianRepairInterval == 0 ||
+                          iteration == lagrangian_iterations - 1)) {
+      lagrangian_placement placement = RepairPlacement(
+          kNetwork, traffic_requests, link_price, cpu_price, sla_weight);
+      if (placement.rejected < best.rejected ||
+          (placement.rejected == best.rejected &&
+           placement.cost < best.cost)) {
+        best = std::move(placement);
+      }
+    }
+    if (best.rejected == 0 && best.cost - lower_bound <= 1e-6 * best.cost) {
+      break;
+    }
+
+    // Polyak step towards the best placement, or a little above the bound
+    // while no placement accepts every traffic
+    double norm = 0;
+    for (int l = 0; l < kLinkCount; ++l) {
+      if (link_price[l] > 0 || link_gradient[l] > 0) {
+        norm += link_gradient[l] * link_gradient[l];
+      }
+    }
+    for (int v = 0; v < kNodeCount; ++v) {
+      if (cpu_price[v] > 0 || cpu_gradient[v] > 0) {
+        norm += cpu_gradient[v] * cpu_gradient[v];
+      }
+    }
+    for (int t = 0; t < kTrafficCount; ++t) {
+      norm += sla_gradient[t] * sla_gradient[t];
+    }
+    if (norm == 0 || !all_routed) break;
+    const double kTarget = best.rejected == 0
+                               ? best.cost
+                               : value + 0.1 * std::fabs(value) + 1;
+    const double kStep = step_scale * (kTarget - value) / norm;
+    for (int l = 0; l < kLinkCount; ++l) {
+      link_price[l] = std::max(0.0, link_price[l] + kStep * link_gradient[l]);
+    }
+    for (int v = 0; v < kNodeCount; ++v) {
+      cpu_price[v] = std::max(0.0, cpu_price[v] + kStep * cpu_gradient[v]);
+    }
+    for (int t = 0; t < kTrafficCount; ++t) {
+      sla_weight[t] =
+          std::min(1.0, std::max(0.0, sla_weight[t] + kStep * sla_gradient[t]));
+    }
+  }
+
+  timestamp->opex = best.cost;
+  timestamp->opex_breakdown = best.cost_breakdown;
+  timestamp->lower_bound = lower_bound;
+  timestamp->rejected = best.rejected;
+  timestamp->sequences.assign(kTrafficCount, std::vector<int>());
+  timestamp->edges.assign(kTrafficCount, std::vector<std::pair<int, int> >());
+  timestamp->all_edges.assign(kTrafficCount,
+                              std::vector<std::pair<int, int> >());
+  timestamp->delays.assign(kTrafficCount, 0);
+  for (int t = 0; t < kTrafficCount; ++t) {
+    if (!best.accepted[t]) continue;
+    timestamp->sequences[t] = best.routes[t].sequence;
+    timestamp->edges[t] = best.routes[t].edges;
+    timestamp->all_edges[t] = best.routes[t].edges;
+    timestamp->delays[t] = best.routes[t].delay;
+  }
+  // the layout of run_cplex: the cores used on the server of every switch,
+  // then the bandwidth between every switch and each of its neighbors
+  const physical_network &network = GetPhysicalNetwork();
+  timestamp->utilization.clear();
+  for (int _n = 0; _n < network.switch_count; ++_n) {
+    timestamp->utilization.push_back(best.used_cores[_n]);
+  }
+  for (int _u = 0; _u < network.switch_count; ++_u) {
+    for (int _v : network.nbr[_u]) {
+      long allocated_bandwidth = 0;
+      for (const std::pair<int, int> &neighbor : kNetwork.adjacency[_u]) {
+        if (neighbor.first == _v) {
+          allocated_bandwidth += best.used_bandwidth[neighbor.second];
+        }
+      }
+      timestamp->utilization.push_back(allocated_bandwidth);
+    }
+  }
+  timestamp->running_time =
+      std::chrono::duration<double>(std::chrono::high_resolution_clock::now() -
+                                    start_time).count();
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_LAGRANGIAN_H_
@@ -9,8 +9,10 @@ std::vector<middlebox> middleboxes;
 std::vector<traffic_request> traffic_requests;
 std::vector<node> nodes;
 std::vector<std::vector<edge_endpoint>> graph;
+std::vector<topology_edge> topology_edges;
 std::vector<double> closeness;
 std::vector<std::vector<middlebox_instance>> deployed_mboxes;
+std::vector<std::vector<middlebox_pool>> mbox_pools;
 std::vector<double> deployment_costs, energy_costs, transit_costs, sla_costs,
     total_costs, stretches;
 std::vector<double> e_cost_ts;
@@ -21,12 +23,14 @@ std::list<int> mbox_count;
 std::vector<int> num_service_points;
 std::vector<double> net_util;
 double per_core_cost, per_bit_transit_cost;
-double cost[MAXN][MAXN];
-int pre[MAXN][MAXN];
-int shortest_path[MAXN][MAXN], sp_pre[MAXN][MAXN];
-int shortest_edge_path[MAXN][MAXN];
-long bw[MAXN][MAXN];
+matrix<int> shortest_path, sp_pre;
+matrix<int> shortest_edge_path;
+matrix<long> bw;
+bottleneck_matrix path_bandwidth;
 int max_time;
+int num_threads = 1;
+std::string apsp_algorithm = "bfs";
+std::string topology_cache_dir;
 std::map<std::pair<int, int>, std::unique_ptr<std::vector<int>>> path_cache;
 solution_statistics stats;
 std::vector<std::unique_ptr<std::vector<int>>> all_results;
@@ -41,6 +45,10 @@ int main(int argc, char *argv[]) {
   for (auto argument : *arg_maps) {
     if (argument.first == "--per_bit_transit_cost") {
       per_bit_transit_cost = atof(argument.second.c_str());
+    } else if (argument.first == "--apsp") {
+      apsp_algorithm = argument.second;
+    } else if (argument.first == "--topology_cache_dir") {
+      topology_cache_dir = argument.second;
     } else if (argument.first == "--topology_file") {
       InitializeTopology(argument.second.c_str());
     } else if (argument.first == "--middlebox_spec_file") {
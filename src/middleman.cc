@@ -3,7 +3,9 @@
 #include "io.h"
 #include "viterbi.h"
 
-#ifdef CPLEX_HW
+#ifdef NO_CPLEX
+// only the Lagrangian engine, which needs no solver
+#elif CPLEX_HW
 #include "cplex4-hw.h"
 #elif CPLEX_HB
 #include "cplex4-hb.h"
@@ -14,28 +16,62 @@
 #else
 #include "cplex4.h"
 #endif
+#include "cplex_model_writer.h"
+#include "cplex_scheduler.h"
+#include "lagrangian.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <map>
 #include <utility>
 #include <memory>
 #include <stdio.h>
 #include <string>
 #include <string.h>
+#include <vector>
 
 const std::string kUsage =
     "./middleman "
     "--per_core_cost=<per_core_cost>\n\t--per_bit_transit_cost=<per_bit_transit"
     "_cost>\n\t--topology_file=<topology_file>\n\t"
     "--middlebox_spec_file=<middlebox_spec_file>\n\t--traffic_r"
-    "equest_file=<traffic_request_file>\n\t--algorithm=<algorithm>";
+    "equest_file=<traffic_request_file>\n\t--algorithm=<algorithm>\n\t"
+    "[--threads=<num_threads>]\n\t[--viterbi_kernel=<pairwise|minplus>]\n\t"
+    "[--apsp=<bfs|floyd_warshall>]\n\t"
+    "[--topology_cache_dir=<dir>] (caches the topology in "
+    "<dir>/<topology_file>.<hash>.cache; off by default)\n\t"
+    "[--cplex_warm_start=<on|off>]\n\t"
+    "[--max_vnf_search=<bisection|parallel>]\n\t"
+    "[--cplex_formulation=<logical|linear>]\n\t"
+    "[--cplex_workers=<num_workers>]\n\t[--cplex_telemetry=<on|off>]\n\t"
+    "[--cplex_pruning=<off|resource|sla>]\n\t"
+    "[--cplex_symmetry=<off|active|load>]\n\t"
+    "[--cplex_lns_iterations=<iterations>]\n\t"
+    "[--cplex_lazy_links=<on|off>]\n\t"
+    "[--lagrangian_iterations=<iterations>]\n\t"
+    "[--cplex_export_model=<cplex4|cplex5>]\n\t"
+    "[--cplex_export_format=<mps|lp>]";
+
+// Whether value is one of the choices of flag; prints the usage if not.
+bool IsKnownChoice(const std::string &flag, const std::string &value,
+                   const std::vector<std::string> &choices) {
+  if (std::find(choices.begin(), choices.end(), value) != choices.end()) {
+    return true;
+  }
+  printf("Unknown %s=%s\n", flag.c_str(), value.c_str());
+  puts(kUsage.c_str());
+  return false;
+}
 
 std::vector<middlebox> middleboxes;
 std::vector<traffic_request> traffic_requests;
 std::vector<node> nodes;
 std::vector<std::vector<edge_endpoint>> graph;
+std::vector<topology_edge> topology_edges;
 std::vector<double> closeness;
 std::vector<std::vector<middlebox_instance>> deployed_mboxes;
+std::vector<std::vector<middlebox_pool>> mbox_pools;
 std::vector<double> deployment_costs, energy_costs, transit_costs, sla_costs,
     total_costs, stretches;
 std::vector<double> e_cost_ts;
@@ -46,12 +82,27 @@ std::list<int> mbox_count;
 std::vector<int> num_service_points;
 std::vector<double> net_util;
 double per_core_cost, per_bit_transit_cost;
-double cost[MAXN][MAXN];
-int pre[MAXN][MAXN];
-int shortest_path[MAXN][MAXN], sp_pre[MAXN][MAXN];
-int shortest_edge_path[MAXN][MAXN];
-long bw[MAXN][MAXN];
+matrix<int> shortest_path, sp_pre;
+matrix<int> shortest_edge_path;
+matrix<long> bw;
+bottleneck_matrix path_bandwidth;
 int max_time;
+int num_threads = 1;
+std::string apsp_algorithm = "bfs";
+std::string topology_cache_dir;
+bool use_cplex_warm_start = false;
+bool use_cplex_telemetry = false;
+bool use_cplex_lazy_links = false;
+std::string max_vnf_search = "bisection";
+std::string cplex_formulation = "logical";
+std::string cplex_pruning = "off";
+std::string cplex_symmetry = "off";
+int cplex_lns_iterations = 0;
+int lagrangian_iterations = 100;
+std::string viterbi_kernel = "pairwise";
+int cplex_workers = 1;
+std::string cplex_export_model = "cplex4";
+std::string cplex_export_format = "mps";
 std::map<std::pair<int, int>, std::unique_ptr<std::vector<int>>> path_cache;
 solution_statistics stats;
 std::vector<std::unique_ptr<std::vector<int>>> all_results;
@@ -65,13 +116,17 @@ int main(int argc, char *argv[]) {
     return 1;
   }
   auto arg_maps = ParseArgs(argc, argv);
-  string algorithm;
-  string topology_filename;
+  std::string algorithm;
+  std::string topology_filename;
   for (auto argument : *arg_maps) {
     if (argument.first == "--per_core_cost") {
       per_core_cost = atof(argument.second.c_str());
     } else if (argument.first == "--per_bit_transit_cost") {
       per_bit_transit_cost = atof(argument.second.c_str());
+    } else if (argument.first == "--apsp") {
+      apsp_algorithm = argument.second;
+    } else if (argument.first == "--topology_cache_dir") {
+      topology_cache_dir = argument.second;
     } else if (argument.first == "--topology_file") {
       topology_filename = argument.second;
       InitializeTopology(argument.second.c_str());
@@ -84,67 +139,118 @@ int main(int argc, char *argv[]) {
       algorithm = argument.second;
     } else if (argument.first == "--max_time") {
       max_time = atoi(argument.second.c_str());
+    } else if (argument.first == "--threads") {
+      num_threads = atoi(argument.second.c_str());
+    } else if (argument.first == "--viterbi_kernel") {
+      viterbi_kernel = argument.second;
+      if (!IsKnownChoice(argument.first, viterbi_kernel,
+                         {"pairwise", "minplus"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_warm_start") {
+      use_cplex_warm_start = argument.second != "off";
+    } else if (argument.first == "--max_vnf_search") {
+      max_vnf_search = argument.second;
+      if (!IsKnownChoice(argument.first, max_vnf_search,
+                         {"bisection", "parallel"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_formulation") {
+      cplex_formulation = argument.second;
+      if (!IsKnownChoice(argument.first, cplex_formulation,
+                         {"logical", "linear"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_workers") {
+      cplex_workers = atoi(argument.second.c_str());
+    } else if (argument.first == "--cplex_telemetry") {
+      use_cplex_telemetry = argument.second != "off";
+    } else if (argument.first == "--cplex_pruning") {
+      cplex_pruning = argument.second;
+      if (!IsKnownChoice(argument.first, cplex_pruning,
+                         {"off", "resource", "sla"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_symmetry") {
+      cplex_symmetry = argument.second;
+      if (!IsKnownChoice(argument.first, cplex_symmetry,
+                         {"off", "active", "load"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_lns_iterations") {
+      cplex_lns_iterations = atoi(argument.second.c_str());
+    } else if (argument.first == "--cplex_lazy_links") {
+      use_cplex_lazy_links = argument.second != "off";
+    } else if (argument.first == "--lagrangian_iterations") {
+      lagrangian_iterations = atoi(argument.second.c_str());
+      if (lagrangian_iterations < 1) {
+        puts("--lagrangian_iterations must be positive");
+        return 1;
+      }
+    } else if (argument.first == "--cplex_export_model") {
+      cplex_export_model = argument.second;
+      if (!IsKnownChoice(argument.first, cplex_export_model,
+                         {"cplex4", "cplex5"})) {
+        return 1;
+      }
+    } else if (argument.first == "--cplex_export_format") {
+      cplex_export_format = argument.second;
+      if (!IsKnownChoice(argument.first, cplex_export_format,
+                         {"mps", "lp"})) {
+        return 1;
+      }
     }
   }
-  if (algorithm == "cplex") {
-    std::vector<traffic_request> current_traffic_requests;
-    int current_time = traffic_requests[0].arrival_time;
-    double opex, running_time;
-    int processed_traffic = 0;
+  if (algorithm == "cplex" || algorithm == "lagrangian") {
+    std::vector<cplex_timestamp> timestamps =
+        GroupByArrivalTime(traffic_requests);
 
     // files to write output
     FILE *cost_log_file = fopen("log.cplex.cost.ts", "w");
     FILE *sequence_log_file = fopen("log.cplex.sequences", "w");
     FILE *path_log_file = fopen("log.cplex.paths", "w");
     FILE *util_log_file = fopen("log.cplex.util.ts", "w");
+    FILE *bound_log_file = nullptr;
+    if (algorithm == "lagrangian") {
+      bound_log_file = fopen("log.cplex.bound.ts", "w");
+    }
 
     // print the node and edge count at the begining of the sequence file
     // fprintf(util_log_file, "%d %d\n", GetNodeCount(graph),
     // GetEdgeCount(graph));
 
-    for (int i = 0; i < traffic_requests.size();) {
-      //      traffic_requests[i].duration = 6000; // 300;
-
-      fprintf(cost_log_file, "%d ", current_time);
-      fprintf(util_log_file, "%d ", current_time);
-
-      for (; i < traffic_requests.size() &&
-                 current_time == traffic_requests[i].arrival_time;
-           ++i) {
-        //        traffic_requests[i].duration = 6000; // 300;
-        current_traffic_requests.push_back(traffic_requests[i]);
-      }
-      current_time = traffic_requests[i].arrival_time;
-
-      std::vector<int> sequence[current_traffic_requests.size()];
-      std::vector<std::vector<std::pair<int, int>>> edges(
-          current_traffic_requests.size());
-      std::vector<std::vector<std::pair<int, int>>> all_edges(
-          current_traffic_requests.size());
-      int delays[current_traffic_requests.size()];
-      std::vector<double> opex_breakdown;
-      std::vector<int> utilization;
-
-      run_cplex(current_traffic_requests, opex, opex_breakdown, running_time,
-                sequence, edges, all_edges, delays, utilization,
-                topology_filename);
-
-      processed_traffic += current_traffic_requests.size();
-
-      // cout << processed_traffic * 100.0 / traffic_requests.size()
-      //     << "% Traffic processed." << endl;
+    auto write_timestamp = [&](const cplex_timestamp &timestamp) {
+      fprintf(cost_log_file, "%d ", timestamp.time);
+      fprintf(util_log_file, "%d ", timestamp.time);
 
       // cost log
-      fprintf(cost_log_file, "%lf ", opex);
-      for (double cost : opex_breakdown) {
+      fprintf(cost_log_file, "%lf ", timestamp.opex);
+      for (double cost : timestamp.opex_breakdown) {
         fprintf(cost_log_file, "%lf ", cost);
       }
       fprintf(cost_log_file, "\n");
 
+      // bound log: time, lower bound, upper bound, gap and the number of
+      // rejected traffics. The bound is nan when some traffic could not be
+      // routed at all. With rejected traffics, opex is the cost of a partial
+      // placement, so the upper bound and the gap are nan.
+      if (bound_log_file) {
+        const bool kHasLowerBound = std::isfinite(timestamp.lower_bound);
+        const bool kHasUpperBound = timestamp.rejected == 0;
+        fprintf(bound_log_file, "%d %lf %lf %lf %d\n", timestamp.time,
+                kHasLowerBound ? timestamp.lower_bound : NAN,
+                kHasUpperBound ? timestamp.opex : NAN,
+                kHasLowerBound && kHasUpperBound
+                    ? (timestamp.opex - timestamp.lower_bound) /
+                          timestamp.opex
+                    : NAN,
+                timestamp.rejected);
+      }
+
       // sequence & path log
-      for (int ii = 0; ii < current_traffic_requests.size(); ++ii) {
+      for (int ii = 0; ii < timestamp.traffic_requests.size(); ++ii) {
         // sequence
-        std::vector<int> seq = sequence[ii];
+        const std::vector<int> &seq = timestamp.sequences[ii];
         /*
         for (int s : seq) {
           cout << s << " ";
@@ -160,8 +266,7 @@ int main(int argc, char *argv[]) {
         fprintf(sequence_log_file, "\n");
 
         // path
-        std::vector<std::pair<int, int>> edge_list = edges[ii];
-        std::vector<std::pair<int, int>> all_edge_list = all_edges[ii];
+        const std::vector<std::pair<int, int>> &edge_list = timestamp.edges[ii];
         /*
         for (std::pair<int, int> edge: edge_list) {
           cout << "(" << edge.first << ", " << edge.second << ") ";
@@ -173,11 +278,14 @@ int main(int argc, char *argv[]) {
         cout << endl;
         */
         DEBUG("Computing path for traffic %d\n", ii);
-        for (auto &edge : edges[ii]) {
+        for (auto &edge : edge_list) {
           DEBUG("(%d, %d)\n", edge.first, edge.second);
         }
         DEBUG("input sent\n");
-        std::vector<int> path = CplexComputePath(edge_list, seq);
+        // the Lagrangian engine leaves the sequence of a rejected traffic
+        // empty
+        std::vector<int> path;
+        if (!seq.empty()) path = CplexComputePath(edge_list, seq);
         for (int j = 0; j < path.size(); ++j) {
           fprintf(path_log_file, "%d", path[j]);
           if (j < path.size() - 1) {
@@ -227,7 +335,7 @@ int main(int argc, char *argv[]) {
       */
 
       // utilization log
-      for (int cores : utilization) {
+      for (int cores : timestamp.utilization) {
         fprintf(util_log_file, "%d ", cores);
       }
       fprintf(util_log_file, "\n");
@@ -236,16 +344,93 @@ int main(int argc, char *argv[]) {
       fflush(sequence_log_file);
       fflush(path_log_file);
       fflush(util_log_file);
-
-      current_traffic_requests.clear();
-      // exit(0);
+      if (bound_log_file) fflush(bound_log_file);
+    };
+    std::function<void(cplex_timestamp *)> solve_timestamp;
+    if (algorithm == "lagrangian") {
+      solve_timestamp = SolveLagrangianTimestamp;
+    } else {
+#ifndef NO_CPLEX
+      solve_timestamp = [&](cplex_timestamp *timestamp) {
+        SolveCplexTimestamp(timestamp, topology_filename);
+      };
+#else
+      puts("This binary is built without CPLEX, use --algorithm=lagrangian");
+      exit(1);
+#endif
     }
+    SolveCplexTimestamps(timestamps, cplex_workers, solve_timestamp,
+                         write_timestamp);
 
     // close all the output files
     fclose(cost_log_file);
     fclose(sequence_log_file);
     fclose(path_log_file);
     fclose(util_log_file);
+    if (bound_log_file) fclose(bound_log_file);
+
+  } else if (algorithm == "cplex_export") {
+    // writes the model of every timestamp to log.cplex.model.<time>.<format>
+    // and how long building, writing and, with CPLEX, loading it took
+    FILE *model_log_file = fopen("log.cplex.model.ts", "w");
+    if (!model_log_file) {
+      puts("Cannot open log.cplex.model.ts");
+      return 1;
+    }
+#ifndef NO_CPLEX
+    int status = 0;
+    CPXENVptr cpx_env = CPXopenCPLEX(&status);
+    if (!cpx_env) {
+      printf("Could not open the CPLEX environment: %d\n", status);
+      return 1;
+    }
+#endif
+    for (const cplex_timestamp &timestamp :
+         GroupByArrivalTime(traffic_requests)) {
+      auto build_start_time = std::chrono::high_resolution_clock::now();
+      sparse_model model = BuildSparseCplexModel(
+          timestamp.traffic_requests, cplex_export_model == "cplex5");
+      auto write_start_time = std::chrono::high_resolution_clock::now();
+      const std::string kModelFilename = "log.cplex.model." +
+                                         std::to_string(timestamp.time) + "." +
+                                         cplex_export_format;
+      FILE *model_file = fopen(kModelFilename.c_str(), "w");
+      if (!model_file) {
+        printf("Cannot open %s\n", kModelFilename.c_str());
+        return 1;
+      }
+      if (cplex_export_format == "lp") {
+        WriteLp(model, model_file);
+      } else {
+        WriteMps(model, model_file);
+      }
+      fclose(model_file);
+      auto load_start_time = std::chrono::high_resolution_clock::now();
+#ifndef NO_CPLEX
+      CPXLPptr lp = CPXcreateprob(cpx_env, &status, kModelFilename.c_str());
+      if (!lp) {
+        printf("Could not create the problem: %d\n", status);
+      } else {
+        status = LoadSparseModel(cpx_env, lp, model);
+        if (status) printf("Could not load the model: %d\n", status);
+        CPXfreeprob(cpx_env, &lp);
+      }
+#endif
+      auto load_end_time = std::chrono::high_resolution_clock::now();
+      fprintf(model_log_file, "%d %d %d %d %lf %lf %lf\n", timestamp.time,
+              model.ColumnCount(), model.RowCount(), model.NonzeroCount(),
+              std::chrono::duration<double>(write_start_time -
+                                            build_start_time).count(),
+              std::chrono::duration<double>(load_start_time -
+                                            write_start_time).count(),
+              std::chrono::duration<double>(load_end_time -
+                                            load_start_time).count());
+      fflush(model_log_file);
+    }
+#ifndef NO_CPLEX
+    CPXcloseCPLEX(&cpx_env);
+#endif
+    fclose(model_log_file);
 
   } else if (algorithm == "viterbi") {
     int current_time = traffic_requests[0].arrival_time;
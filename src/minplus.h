@@ -0,0 +1,108 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_MINPLUS_H_
+#define MIDDLEBOX_PLACEMENT_SRC_MINPLUS_H_
+
+#include "datastructure.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINPLUS_X86 1
+#include <immintrin.h>
+#endif
+
+// Min-plus vector-matrix product over one tile of a stage transition matrix.
+// The tile has num_rows rows of width doubles, row r holding the transition
+// costs from node row_ids[r] to width consecutive nodes. For every column j,
+//   acc[j] = min(acc[j], row_cost[r] + tile[r * width + j])
+// over r in increasing order, and arg[j] is set to row_ids[r] whenever acc[j]
+// strictly improves. Ties therefore keep the lowest row, and the result is
+// the same as the scalar loop for every instruction set. Infeasible
+// transitions are +infinity in the tile and never improve acc.
+
+// Scalar reduction of the columns [first_column, width).
+inline void MinPlusReduceScalar(const double *row_cost, const int *row_ids,
+                                int num_rows, const double *tile, int width,
+                                double *acc, int *arg, int first_column = 0) {
+  for (int r = 0; r < num_rows; ++r) {
+    const double *tile_row = tile + static_cast<size_t>(r) * width;
+    for (int j = first_column; j < width; ++j) {
+      double transition_cost = row_cost[r] + tile_row[j];
+      if (acc[j] > transition_cost) {
+        acc[j] = transition_cost;
+        arg[j] = row_ids[r];
+      }
+    }
+  }
+}
+
+#ifdef MINPLUS_X86
+__attribute__((target("avx2"))) inline void MinPlusReduceAvx2(
+    const double *row_cost, const int *row_ids, int num_rows,
+    const double *tile, int width, double *acc, int *arg) {
+  const int kLanes = 4;
+  int j = 0;
+  for (; j + kLanes <= width; j += kLanes) {
+    __m256d best = _mm256_loadu_pd(acc + j);
+    __m256d best_row = _mm256_cvtepi32_pd(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(arg + j)));
+    for (int r = 0; r < num_rows; ++r) {
+      const double *tile_row = tile + static_cast<size_t>(r) * width;
+      __m256d transition_cost = _mm256_add_pd(_mm256_set1_pd(row_cost[r]),
+                                              _mm256_loadu_pd(tile_row + j));
+      __m256d improved = _mm256_cmp_pd(transition_cost, best, _CMP_LT_OQ);
+      best = _mm256_blendv_pd(best, transition_cost, improved);
+      best_row = _mm256_blendv_pd(
+          best_row, _mm256_set1_pd(static_cast<double>(row_ids[r])), improved);
+    }
+    _mm256_storeu_pd(acc + j, best);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(arg + j),
+                     _mm256_cvtpd_epi32(best_row));
+  }
+  MinPlusReduceScalar(row_cost, row_ids, num_rows, tile, width, acc, arg, j);
+}
+
+__attribute__((target("avx512f"))) inline void MinPlusReduceAvx512(
+    const double *row_cost, const int *row_ids, int num_rows,
+    const double *tile, int width, double *acc, int *arg) {
+  const int kLanes = 8;
+  int j = 0;
+  for (; j + kLanes <= width; j += kLanes) {
+    __m512d best = _mm512_loadu_pd(acc + j);
+    // the 8 row ids in the low half, loaded and stored with a mask so the
+    // 256-bit halves never need a cast
+    __m512i best_row = _mm512_maskz_loadu_epi32(0x00ff, arg + j);
+    for (int r = 0; r < num_rows; ++r) {
+      const double *tile_row = tile + static_cast<size_t>(r) * width;
+      __m512d transition_cost = _mm512_add_pd(_mm512_set1_pd(row_cost[r]),
+                                              _mm512_loadu_pd(tile_row + j));
+      __mmask8 improved =
+          _mm512_cmp_pd_mask(transition_cost, best, _CMP_LT_OQ);
+      best = _mm512_mask_blend_pd(improved, best, transition_cost);
+      best_row = _mm512_mask_blend_epi32(static_cast<__mmask16>(improved),
+                                         best_row,
+                                         _mm512_set1_epi32(row_ids[r]));
+    }
+    _mm512_storeu_pd(acc + j, best);
+    _mm512_mask_storeu_epi32(arg + j, 0x00ff, best_row);
+  }
+  MinPlusReduceScalar(row_cost, row_ids, num_rows, tile, width, acc, arg, j);
+}
+#endif  // MINPLUS_X86
+
+inline void MinPlusReduce(const double *row_cost, const int *row_ids,
+                          int num_rows, const double *tile, int width,
+                          double *acc, int *arg) {
+#ifdef MINPLUS_X86
+  static const bool kHasAvx512 = __builtin_cpu_supports("avx512f");
+  static const bool kHasAvx2 = __builtin_cpu_supports("avx2");
+  if (kHasAvx512) {
+    MinPlusReduceAvx512(row_cost, row_ids, num_rows, tile, width, acc, arg);
+    return;
+  }
+  if (kHasAvx2) {
+    MinPlusReduceAvx2(row_cost, row_ids, num_rows, tile, width, acc, arg);
+    return;
+  }
+#endif
+  MinPlusReduceScalar(row_cost, row_ids, num_rows, tile, width, acc, arg);
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_MINPLUS_H_
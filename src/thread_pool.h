@@ -0,0 +1,111 @@
+#ifndef MIDDLEBOX_PLACEMENT_SRC_THREAD_POOL_H_
+#define MIDDLEBOX_PLACEMENT_SRC_THREAD_POOL_H_
+
+#include "datastructure.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that split an index range into contiguous
+// chunks. The calling thread always runs the first chunk itself, so a pool of
+// size 1 has no workers and runs everything serially.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads)
+      : body_(nullptr), begin_(0), end_(0), generation_(0), pending_(0),
+        shutdown_(false) {
+    for (int i = 1; i < num_threads; ++i) {
+      workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    work_ready_.notify_all();
+    for (auto &worker : workers_) worker.join();
+  }
+
+  int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls body(chunk_begin, chunk_end) once per chunk of [begin, end) and
+  // returns when all chunks are done. Chunk boundaries only depend on the
+  // range and the pool size. Calls from different threads take turns; body
+  // must not call ParallelFor itself.
+  void ParallelFor(int begin, int end,
+                   const std::function<void(int, int)> &body) {
+    if (workers_.empty() || end - begin < 2) {
+      body(begin, end);
+      return;
+    }
+    std::unique_lock<std::mutex> caller_lock(caller_mutex_);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      body_ = &body;
+      begin_ = begin;
+      end_ = end;
+      pending_ = static_cast<int>(workers_.size());
+      ++generation_;
+    }
+    work_ready_.notify_all();
+    body(begin, ChunkBoundary(begin, end, 1));
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this] { return pending_ == 0; });
+    body_ = nullptr;
+  }
+
+ private:
+  int ChunkBoundary(int begin, int end, int chunk) const {
+    const long long kRange = end - begin;
+    return begin + static_cast<int>(kRange * chunk / size());
+  }
+
+  void WorkerLoop(int chunk) {
+    unsigned long long seen_generation = 0;
+    while (true) {
+      const std::function<void(int, int)> *body;
+      int begin, end;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_ready_.wait(lock, [this, seen_generation] {
+          return shutdown_ || generation_ != seen_generation;
+        });
+        if (shutdown_) return;
+        seen_generation = generation_;
+        body = body_;
+        begin = begin_;
+        end = end_;
+      }
+      (*body)(ChunkBoundary(begin, end, chunk),
+              ChunkBoundary(begin, end, chunk + 1));
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        --pending_;
+      }
+      work_done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_, caller_mutex_;
+  std::condition_variable work_ready_, work_done_;
+  const std::function<void(int, int)> *body_;
+  int begin_, end_;
+  unsigned long long generation_;
+  int pending_;
+  bool shutdown_;
+};
+
+// The process-wide pool, sized by the --threads flag. It is created on first
+// use, so num_threads must be set before then.
+inline ThreadPool &GetThreadPool() {
+  static ThreadPool pool(num_threads > 0 ? num_threads : 1);
+  return pool;
+}
+
+#endif  // MIDDLEBOX_PLACEMENT_SRC_THREAD_POOL_H_
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <limits>
 #include <set>
 #include <stack>
 #include <stdarg.h>
@@ -119,34 +120,124 @@ inline unsigned long GetEdgeResidualBandwidth(int source, int destination) {
   return bw[source][destination];
 }
 
-inline unsigned long GetPathResidualBandwidth(int source, int destination) {
-  std::vector<int> *path_ptr = nullptr;
-  std::pair<int, int> cache_index(source, destination);
-  if (path_cache[cache_index]) {
-    path_ptr = path_cache[cache_index].get();
-  } else {
-    path_cache[cache_index] = ComputeShortestPath(source, destination);
-    path_ptr = path_cache[cache_index].get();
-  }
+// Walks the shortest path backwards through sp_pre and returns the smallest
+// residual bandwidth of its edges.
+inline unsigned long ComputePathResidualBandwidth(int source,
+                                                  int destination) {
   unsigned long residual_bandwidth = 100000000000000L;
-  for (int i = 0; i < static_cast<int>(path_ptr->size()) - 1; ++i) {
-    DEBUG("edge[%d][%d] = %d\n", path_ptr->at(i), path_ptr->at(i + 1),
-          GetEdgeResidualBandwidth(path_ptr->at(i), path_ptr->at(i + 1)));
-    residual_bandwidth = std::min(
-        residual_bandwidth,
-        GetEdgeResidualBandwidth(path_ptr->at(i), path_ptr->at(i + 1)));
+  int current = destination;
+  int previous = sp_pre[source][current];
+  while (previous != NIL) {
+    DEBUG("edge[%d][%d] = %d\n", previous, current,
+          GetEdgeResidualBandwidth(previous, current));
+    residual_bandwidth = std::min(residual_bandwidth,
+                                  GetEdgeResidualBandwidth(previous, current));
+    current = previous;
+    previous = sp_pre[source][current];
   }
   return residual_bandwidth;
 }
 
+// A single read from path_bandwidth, so it is safe to call from the Viterbi
+// worker threads.
+inline unsigned long GetPathResidualBandwidth(int source, int destination) {
+  return path_bandwidth
+      .residual[static_cast<size_t>(source) * path_bandwidth.num_nodes +
+                destination];
+}
+
+inline int GetEdgeIndex(int source, int destination) {
+  for (int i = 0; i < graph[source].size(); ++i) {
+    if (graph[source][i].u->node_id == destination) {
+      return path_bandwidth.edge_offset[source] + i;
+    }
+  }
+  return NIL;
+}
+
+// Builds path_bandwidth from sp_pre and bw. Called once the shortest paths
+// of the topology are known.
+void InitializePathBandwidth() {
+  const int kNumNodes = graph.size();
+  bottleneck_matrix &pb = path_bandwidth;
+  pb.num_nodes = kNumNodes;
+  pb.edge_offset.assign(kNumNodes + 1, 0);
+  for (int u = 0; u < kNumNodes; ++u) {
+    pb.edge_offset[u + 1] = pb.edge_offset[u] + graph[u].size();
+  }
+  const int kNumEdges = pb.edge_offset[kNumNodes];
+  pb.residual.resize(static_cast<size_t>(kNumNodes) * kNumNodes);
+  pb.pair_offset.assign(kNumEdges + 1, 0);
+  // Counts the pairs of every edge first, then fills them in.
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<int> next_pair(pb.pair_offset.begin(), pb.pair_offset.end());
+    for (int source = 0; source < kNumNodes; ++source) {
+      for (int destination = 0; destination < kNumNodes; ++destination) {
+        const int kPair = source * kNumNodes + destination;
+        if (pass == 0) {
+          pb.residual[kPair] =
+              ComputePathResidualBandwidth(source, destination);
+        }
+        int current = destination;
+        int previous = sp_pre[source][current];
+        while (previous != NIL) {
+          const int kEdge = GetEdgeIndex(previous, current);
+          if (pass == 0) {
+            ++pb.pair_offset[kEdge + 1];
+          } else {
+            pb.pairs[next_pair[kEdge]++] = kPair;
+          }
+          current = previous;
+          previous = sp_pre[source][current];
+        }
+      }
+    }
+    if (pass == 0) {
+      for (int e = 0; e < kNumEdges; ++e) {
+        pb.pair_offset[e + 1] += pb.pair_offset[e];
+      }
+      pb.pairs.resize(pb.pair_offset[kNumEdges]);
+    }
+  }
+  pb.initial = pb.residual;
+}
+
+// Brings the bottleneck of every pair crossing the directed edge (source,
+// destination) up to date after its residual bandwidth changed from
+// old_bandwidth. A decrease only needs a min with the new value; otherwise
+// the paths are walked again.
+inline void UpdatePathBandwidth(int source, int destination,
+                                unsigned long old_bandwidth) {
+  bottleneck_matrix &pb = path_bandwidth;
+  const int kEdge = GetEdgeIndex(source, destination);
+  if (kEdge == NIL) return;
+  const unsigned long kNewBandwidth =
+      GetEdgeResidualBandwidth(source, destination);
+  for (int i = pb.pair_offset[kEdge]; i < pb.pair_offset[kEdge + 1]; ++i) {
+    const int kPair = pb.pairs[i];
+    if (kNewBandwidth <= old_bandwidth) {
+      pb.residual[kPair] = std::min(pb.residual[kPair], kNewBandwidth);
+    } else {
+      pb.residual[kPair] = ComputePathResidualBandwidth(
+          kPair / pb.num_nodes, kPair % pb.num_nodes);
+    }
+  }
+}
+
 inline void ReduceEdgeResidualBandwidth(int source, int destination,
                                         unsigned long bandwidth) {
+  const unsigned long kForward = GetEdgeResidualBandwidth(source, destination);
+  const unsigned long kBackward =
+      GetEdgeResidualBandwidth(destination, source);
   bw[source][destination] -= bandwidth;
   bw[destination][source] -= bandwidth;
+  UpdatePathBandwidth(source, destination, kForward);
+  UpdatePathBandwidth(destination, source, kBackward);
 }
 
 void DecommissionAllMiddleboxes() {
   for (auto &mboxes : deployed_mboxes) mboxes.clear();
+  for (auto &pools : mbox_pools) pools.clear();
 }
 
 void ReleaseBandwidth() {
@@ -158,6 +249,7 @@ void ReleaseBandwidth() {
           endpoint.bandwidth;
     }
   }
+  path_bandwidth.residual = path_bandwidth.initial;
 }
 
 void ReleaseCPU() {
@@ -193,18 +285,37 @@ inline void ReduceNodeCapacity(int node, const middlebox &m_box) {
   nodes[node].residual_cores -= m_box.cpu_requirement;
 }
 
+inline int GetMiddleboxType(const middlebox &m_box) {
+  assert(&m_box >= middleboxes.data() &&
+         &m_box < middleboxes.data() + middleboxes.size());
+  return &m_box - middleboxes.data();
+}
+
+inline const middlebox_pool *GetMiddleboxPool(int current_node,
+                                              const middlebox &m_box) {
+  const int kType = GetMiddleboxType(m_box);
+  if (kType >= mbox_pools[current_node].size()) return nullptr;
+  return &mbox_pools[current_node][kType];
+}
+
+// Returns true if current_node has an instance of m_box with enough residual
+// capacity for t_request, i.e., if UsedMiddleboxIndex would not return NIL.
+inline bool IsMiddleboxReusable(int current_node, const middlebox &m_box,
+                                const traffic_request &t_request) {
+  const middlebox_pool *pool = GetMiddleboxPool(current_node, m_box);
+  return pool && !pool->instances.empty() &&
+         pool->max_residual_capacity >= t_request.min_bandwidth;
+}
+
+// Returns the index into deployed_mboxes[current_node] of the first deployed
+// instance of m_box with enough residual capacity for t_request, or NIL.
 int UsedMiddleboxIndex(int current_node, const middlebox &m_box,
                        const traffic_request &t_request) {
-  for (int i = 0; i < deployed_mboxes[current_node].size(); ++i) {
-    DEBUG("deployed_mboxes[current_node][i].m_box->middlebox_name = %s\n",
-          deployed_mboxes[current_node][i].m_box->middlebox_name.c_str());
-    DEBUG("m_box.middlebox_name = %s\n", m_box.middlebox_name.c_str());
-    if (deployed_mboxes[current_node][i].m_box->middlebox_name ==
-        m_box.middlebox_name) {
-      if (deployed_mboxes[current_node][i].residual_capacity >=
-          t_request.min_bandwidth) {
-        return i;
-      }
+  if (!IsMiddleboxReusable(current_node, m_box, t_request)) return NIL;
+  for (int i : GetMiddleboxPool(current_node, m_box)->instances) {
+    if (deployed_mboxes[current_node][i].residual_capacity >=
+        t_request.min_bandwidth) {
+      return i;
     }
   }
   return NIL;
@@ -214,12 +325,31 @@ void UpdateMiddleboxInstances(int current_node, const middlebox *m_box,
                               const traffic_request &t_request) {
   int used_middlebox_index =
       UsedMiddleboxIndex(current_node, *m_box, t_request);
+  const int kType = GetMiddleboxType(*m_box);
+  if (kType >= mbox_pools[current_node].size()) {
+    mbox_pools[current_node].resize(middleboxes.size());
+  }
+  middlebox_pool &pool = mbox_pools[current_node][kType];
   if (used_middlebox_index != NIL) {
     deployed_mboxes[current_node][used_middlebox_index].residual_capacity -=
         t_request.min_bandwidth;
+    pool.max_residual_capacity =
+        deployed_mboxes[current_node][pool.instances[0]].residual_capacity;
+    for (int i : pool.instances) {
+      pool.max_residual_capacity =
+          std::max(pool.max_residual_capacity,
+                   deployed_mboxes[current_node][i].residual_capacity);
+    }
   } else {
     deployed_mboxes[current_node].emplace_back(
         m_box, m_box->processing_capacity - t_request.min_bandwidth);
+    if (pool.instances.empty() ||
+        deployed_mboxes[current_node].back().residual_capacity >
+            pool.max_residual_capacity) {
+      pool.max_residual_capacity =
+          deployed_mboxes[current_node].back().residual_capacity;
+    }
+    pool.instances.push_back(deployed_mboxes[current_node].size() - 1);
     ReduceNodeCapacity(current_node, *m_box);
   }
 }
@@ -240,6 +370,18 @@ void UpdateResources(const std::vector<int> *traffic_sequence,
   }
 }
 
+inline int GetResidualCores(int node_id, const resource &resource_vector) {
+  int residual_cores = nodes[node_id].residual_cores;
+  for (auto &used : resource_vector.used_cores) {
+    if (used.first == node_id) residual_cores -= used.second;
+  }
+  return residual_cores;
+}
+
+inline void ConsumeCores(int node_id, int cores, resource &resource_vector) {
+  resource_vector.used_cores.emplace_back(node_id, cores);
+}
+
 inline int IsResourceAvailable(int prev_node, int current_node,
                                const resource &resource_vector,
                                const middlebox &m_box,
@@ -249,17 +391,18 @@ inline int IsResourceAvailable(int prev_node, int current_node,
       "req_cores = %d\n",
       prev_node, current_node,
       GetPathResidualBandwidth(prev_node, current_node),
-      t_request.min_bandwidth, resource_vector.cpu_cores[current_node],
+      t_request.min_bandwidth, GetResidualCores(current_node, resource_vector),
       m_box.cpu_requirement);
   if ((GetPathResidualBandwidth(prev_node, current_node) >=
        t_request.min_bandwidth)) {
     // Check if we can use existing middlebox of the same type.
-    if (UsedMiddleboxIndex(current_node, m_box, t_request) != NIL) {
+    if (IsMiddleboxReusable(current_node, m_box, t_request)) {
       return 1;
     }
     // If we cannot use existing ones, then we need to instantiate new one.
     if (m_box.processing_capacity >= t_request.min_bandwidth &&
-        resource_vector.cpu_cores[current_node] >= m_box.cpu_requirement) {
+        GetResidualCores(current_node, resource_vector) >=
+            m_box.cpu_requirement) {
       return 1;
     }
   }
@@ -288,14 +431,19 @@ double GetSLAViolationCost(int source, int destination, double max_delay,
   return 0;
 }
 
-inline double GetTransitCost(int prev_node, int current_node,
-                             const traffic_request &t_request) {
-  int path_length = shortest_edge_path[prev_node][current_node];
+inline double GetTransitCostForHops(int path_length,
+                                    const traffic_request &t_request) {
   if (path_length >= INF) return INF;
   return (1.0 / 1000.0) * path_length * per_bit_transit_cost *
          t_request.min_bandwidth * t_request.duration;
 }
 
+inline double GetTransitCost(int prev_node, int current_node,
+                             const traffic_request &t_request) {
+  return GetTransitCostForHops(shortest_edge_path[prev_node][current_node],
+                               t_request);
+}
+
 double GetServerEnergyConsumption(int num_cores_used) {
   int full_servers_used = num_cores_used / NUM_CORES_PER_SERVER;
   double energy_consumed =
@@ -308,11 +456,11 @@ double GetServerEnergyConsumption(int num_cores_used) {
 inline double GetEnergyCost(int current_node, const middlebox &m_box,
                             const resource &resource_vector,
                             const traffic_request &t_request) {
-  if (UsedMiddleboxIndex(current_node, m_box, t_request) != NIL) {
+  if (IsMiddleboxReusable(current_node, m_box, t_request)) {
     return 0;
   }
-  int previously_used_cores =
-      nodes[current_node].num_cores - resource_vector.cpu_cores[current_node];
+  int previously_used_cores = nodes[current_node].num_cores -
+                              GetResidualCores(current_node, resource_vector);
   int currently_used_cores = previously_used_cores + m_box.cpu_requirement;
   double duration_hours =
       static_cast<double>(t_request.duration) / (60.0 * 60.0);
@@ -331,7 +479,7 @@ inline double GetEnergyCost(int current_node, const middlebox &m_box,
 inline double GetDeploymentCost(int current_node, const middlebox &m_box,
                                 const traffic_request &t_request) {
   // If we can use existing middlebox then there is no deployment cost.
-  if (UsedMiddleboxIndex(current_node, m_box, t_request) != NIL) {
+  if (IsMiddleboxReusable(current_node, m_box, t_request)) {
     return 0.0;
   }
   return m_box.deployment_cost;
@@ -354,6 +502,89 @@ double GetCost(int prev_node, int current_node, const resource &resource_vector,
   return deployment_cost + energy_cost + transit_cost + sla_violation_cost;
 }
 
+// The terms of GetCost for one stage of a traffic request that do not depend
+// on the previous node, indexed by the current node. Building them once per
+// stage leaves only the per-pair terms, which are read from the static
+// shortest path matrices, to GetTransitionCost.
+struct stage_costs {
+  // IsMiddleboxReusable(node, m_box, t_request).
+  std::vector<char> reusable;
+  std::vector<double> deployment_cost;
+  // Energy cost when the partial embedding has not consumed cores on node.
+  std::vector<double> energy_cost;
+  // GetTransitCost(node, t_request.destination, t_request).
+  std::vector<double> egress_transit_cost;
+  // GetTransitCost for a path of h hops, indexed by h.
+  std::vector<double> transit_cost_by_hops;
+  double per_segment_latency_bound;
+};
+
+const int kMaxPrecomputedHops = 64;
+
+void ComputeStageCosts(const middlebox &m_box,
+                       const traffic_request &t_request, stage_costs &costs) {
+  const int kNumNodes = nodes.size();
+  const resource kNoUsedCores;
+  costs.reusable.resize(kNumNodes);
+  costs.deployment_cost.resize(kNumNodes);
+  costs.energy_cost.resize(kNumNodes);
+  costs.egress_transit_cost.resize(kNumNodes);
+  for (int node = 0; node < kNumNodes; ++node) {
+    costs.reusable[node] = IsMiddleboxReusable(node, m_box, t_request);
+    costs.deployment_cost[node] = GetDeploymentCost(node, m_box, t_request);
+    costs.energy_cost[node] =
+        GetEnergyCost(node, m_box, kNoUsedCores, t_request);
+    costs.egress_transit_cost[node] =
+        GetTransitCost(node, t_request.destination, t_request);
+  }
+  costs.transit_cost_by_hops.resize(kMaxPrecomputedHops);
+  for (int hops = 0; hops < kMaxPrecomputedHops; ++hops) {
+    costs.transit_cost_by_hops[hops] = GetTransitCostForHops(hops, t_request);
+  }
+  const int kNumSegments = t_request.middlebox_sequence.size() + 1;
+  costs.per_segment_latency_bound = (1.0 * t_request.max_delay) / kNumSegments;
+}
+
+// IsResourceAvailable and GetCost for one transition, built from the stage
+// costs. Returns +infinity if the transition is not feasible. Every term is
+// computed by the same expression and summed in the same order as in
+// GetCost, so the result is bit-identical to it.
+inline double GetTransitionCost(int prev_node, int current_node,
+                                const resource &resource_vector,
+                                const middlebox &m_box,
+                                const traffic_request &t_request,
+                                const stage_costs &costs) {
+  if (GetPathResidualBandwidth(prev_node, current_node) <
+      t_request.min_bandwidth) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double energy_cost = costs.energy_cost[current_node];
+  if (!costs.reusable[current_node]) {
+    int residual_cores = GetResidualCores(current_node, resource_vector);
+    if (m_box.processing_capacity < t_request.min_bandwidth ||
+        residual_cores < m_box.cpu_requirement) {
+      return std::numeric_limits<double>::infinity();
+    }
+    if (residual_cores != nodes[current_node].residual_cores) {
+      energy_cost =
+          GetEnergyCost(current_node, m_box, resource_vector, t_request);
+    }
+  }
+  int hops = shortest_edge_path[prev_node][current_node];
+  double transit_cost = hops < kMaxPrecomputedHops
+                            ? costs.transit_cost_by_hops[hops]
+                            : GetTransitCostForHops(hops, t_request);
+  transit_cost += costs.egress_transit_cost[current_node];
+  double sla_violation_cost = 0.0;
+  int delay = shortest_path[prev_node][current_node] + m_box.processing_delay;
+  if (delay > costs.per_segment_latency_bound) {
+    sla_violation_cost =
+        (delay - costs.per_segment_latency_bound) * t_request.delay_penalty;
+  }
+  return costs.deployment_cost[current_node] + energy_cost + transit_cost +
+         sla_violation_cost;
+}
+
 inline int GetLatency(int source, int destination) {
   for (edge_endpoint endpoint : graph[source]) {
     if (endpoint.u->node_id == destination) return endpoint.delay;
@@ -419,8 +650,6 @@ void ComputeSolutionCosts(const std::vector<std::vector<int> > &solutions) {
     double total_delay = 0.0;
     int embedded_path_length = 0;
     resource resource_vector;
-    for (auto &node : nodes)
-      resource_vector.cpu_cores.push_back(node.residual_cores);
     for (int kk = 1; kk < current_solution.size(); ++kk) {
       auto &m_box = middleboxes[traffic_requests[i].middlebox_sequence[kk - 1]];
       int current_node = current_solution[kk];
@@ -442,8 +671,8 @@ void ComputeSolutionCosts(const std::vector<std::vector<int> > &solutions) {
 
       // Update the resource vector with any new middleboxes.
       if (kk != kLastIndex &&
-          UsedMiddleboxIndex(current_node, m_box, traffic_requests[i]) == NIL) {
-        resource_vector.cpu_cores[current_node] -= m_box.cpu_requirement;
+          !IsMiddleboxReusable(current_node, m_box, traffic_requests[i])) {
+        ConsumeCores(current_node, m_box.cpu_requirement, resource_vector);
       }
 
       // Compute total delay for SLA violation cost.
@@ -2,98 +2,242 @@
 #define MIDDLEBOX_PLACEMENT_SRC_VITERBI_H_
 
 #include "datastructure.h"
+#include "minplus.h"
+#include "thread_pool.h"
 #include "util.h"
 #include <algorithm>
+#include <limits>
 
-void ViterbiInit() {
-  for (int i = 0; i < MAXN; ++i) {
-    for (int j = 0; j < MAXN; ++j) {
-      cost[i][j] = INF;
-      pre[i][j] = NIL;
+// Cost and back-pointer tables of the Viterbi engine, one row of
+// num_nodes cells per stage. The rows are kept across requests and only grow
+// to the longest middlebox sequence seen so far. Each row carries the epoch
+// of the request that last reset it, so a request only resets the rows it
+// actually uses.
+struct viterbi_table {
+  int num_nodes;
+  unsigned long long epoch;
+  std::vector<double> cost;
+  std::vector<int> pre;
+  std::vector<unsigned long long> row_epoch;
+  viterbi_table() : num_nodes(0), epoch(0) {}
+
+  // Starts a new request with num_stages rows of n_nodes cells each.
+  void Init(int num_stages, int n_nodes) {
+    if (n_nodes != num_nodes) {
+      num_nodes = n_nodes;
+      cost.clear();
+      pre.clear();
+      row_epoch.clear();
+    }
+    if (static_cast<int>(row_epoch.size()) < num_stages) {
+      cost.resize(static_cast<size_t>(num_stages) * num_nodes);
+      pre.resize(static_cast<size_t>(num_stages) * num_nodes);
+      row_epoch.resize(num_stages, 0);
+    }
+    ++epoch;
+  }
+
+  // Resets the row of a stage to INF/NIL unless it was already reset for the
+  // current request. Must not be called concurrently.
+  void InitRow(int stage) {
+    if (row_epoch[stage] == epoch) return;
+    std::fill(CostRow(stage), CostRow(stage) + num_nodes,
+              static_cast<double>(INF));
+    std::fill(PreRow(stage), PreRow(stage) + num_nodes, NIL);
+    row_epoch[stage] = epoch;
+  }
+
+  double *CostRow(int stage) {
+    return &cost[static_cast<size_t>(stage) * num_nodes];
+  }
+  int *PreRow(int stage) { return &pre[static_cast<size_t>(stage) * num_nodes]; }
+};
+
+// Sets the resource usage of current_node's state to that of its chosen
+// predecessor min_index, plus the cores of a new middlebox if one has to be
+// deployed. Unreachable states (min_index == NIL) get an empty usage list.
+void ViterbiUpdateState(int current_node, int min_index,
+                        const middlebox &m_box,
+                        const traffic_request &t_request,
+                        const std::vector<resource> &previous_vector,
+                        std::vector<resource> &current_vector) {
+  if (min_index != NIL) {
+    DEBUG("Current node = %d, min_index = %d\n", current_node, min_index);
+    current_vector[current_node] = previous_vector[min_index];
+    if (!IsMiddleboxReusable(current_node, m_box, t_request)) {
+      ConsumeCores(current_node, m_box.cpu_requirement,
+                   current_vector[current_node]);
+    }
+  } else {
+    current_vector[current_node].used_cores.clear();
+  }
+}
+
+// Computes the cost and back-pointer of current_node at a stage from the
+// previous stage, and the resource usage of the chosen back-pointer chain.
+void ViterbiRelax(int stage, int current_node, const middlebox &m_box,
+                  const traffic_request &t_request, const stage_costs &costs,
+                  const std::vector<resource> &previous_vector,
+                  std::vector<resource> &current_vector,
+                  viterbi_table &table) {
+  const int kNumNodes = previous_vector.size();
+  const double *prev_cost = table.CostRow(stage - 1);
+  double &cur_cost = table.CostRow(stage)[current_node];
+  int &cur_pre = table.PreRow(stage)[current_node];
+  int min_index = NIL;
+  for (int prev_node = 0; prev_node < kNumNodes; ++prev_node) {
+    double cost = GetTransitionCost(prev_node, current_node,
+                                    previous_vector[prev_node], m_box,
+                                    t_request, costs);
+    if (cost < std::numeric_limits<double>::infinity()) {
+      double transition_cost = prev_cost[prev_node] + cost;
+      DEBUG(
+          "[stage = %d, middlebox = %s, prev_node = %d, tr_cost = "
+          "%lf]\n",
+          stage, m_box.middlebox_name.c_str(), prev_node, transition_cost);
+      if (cur_cost > transition_cost) {
+        cur_cost = transition_cost;
+        cur_pre = prev_node;
+        min_index = prev_node;
+      }
+    }
+  }
+  DEBUG("[stage = %d, min_index = %d]\n", stage, min_index);
+  ViterbiUpdateState(current_node, min_index, m_box, t_request,
+                     previous_vector, current_vector);
+}
+
+// Width of a min-plus tile in destination nodes. A tile has one row of 8-byte
+// costs per reachable previous node, so with 1000 of them it takes 512 KB,
+// more than many L2 caches. It is written once and read once, so narrower
+// tiles that stay in L2 only add per-row overhead: widths sized to 128 or
+// 256 KB were about 15% slower on dc.k28.
+const int kMinPlusTileWidth = 64;
+
+// Same as calling ViterbiRelax for every node in [node_begin, node_end), but
+// the transition costs from the reachable previous nodes are first written
+// into a contiguous tile, which MinPlusReduce then reduces with SIMD.
+// reachable lists the previous nodes with a finite cost in increasing order
+// and reachable_cost holds their costs. Nodes with an INF cost can be skipped
+// because GetCost is never negative, so they never win the strict comparison
+// against the INF initial value.
+void ViterbiRelaxMinPlus(int stage, int node_begin, int node_end,
+                         const middlebox &m_box,
+                         const traffic_request &t_request,
+                         const stage_costs &costs,
+                         const std::vector<int> &reachable,
+                         const std::vector<double> &reachable_cost,
+                         const std::vector<resource> &previous_vector,
+                         std::vector<resource> &current_vector,
+                         viterbi_table &table) {
+  static thread_local std::vector<double> tile;
+  const int kNumRows = reachable.size();
+  double *cur_cost = table.CostRow(stage);
+  int *cur_pre = table.PreRow(stage);
+  for (int tile_begin = node_begin; tile_begin < node_end;
+       tile_begin += kMinPlusTileWidth) {
+    const int kWidth = std::min(kMinPlusTileWidth, node_end - tile_begin);
+    tile.resize(static_cast<size_t>(kNumRows) * kWidth);
+    for (int r = 0; r < kNumRows; ++r) {
+      const int prev_node = reachable[r];
+      double *tile_row = &tile[static_cast<size_t>(r) * kWidth];
+      for (int j = 0; j < kWidth; ++j) {
+        const int current_node = tile_begin + j;
+        tile_row[j] =
+            GetTransitionCost(prev_node, current_node,
+                              previous_vector[prev_node], m_box, t_request,
+                              costs);
+      }
+    }
+    MinPlusReduce(reachable_cost.data(), reachable.data(), kNumRows,
+                  tile.data(), kWidth, cur_cost + tile_begin,
+                  cur_pre + tile_begin);
+    for (int current_node = tile_begin; current_node < tile_begin + kWidth;
+         ++current_node) {
+      ViterbiUpdateState(current_node, cur_pre[current_node], m_box, t_request,
+                         previous_vector, current_vector);
     }
   }
 }
 
 std::unique_ptr<std::vector<int> > ViterbiCompute(
     const traffic_request &t_request) {
-  ViterbiInit();
-  int stage = 0, node = NIL;
+  static viterbi_table table;
+  int stage = 0;
   const static int kNumNodes = graph.size();
   const int kNumStages = t_request.middlebox_sequence.size();
+  table.Init(kNumStages, kNumNodes);
+  // Each state only keeps the cores consumed along its own back-pointer
+  // chain; the rest is read from nodes[].residual_cores.
   std::vector<resource> current_vector, previous_vector;
   current_vector.resize(kNumNodes);
   previous_vector.resize(kNumNodes);
-
-  for (int i = 0; i < kNumNodes; ++i) {
-    for (int j = 0; j < kNumNodes; ++j) {
-      current_vector[i].cpu_cores.push_back(nodes[j].residual_cores);
-    }
-  }
-  for (node = 0; node < kNumNodes; ++node) {
-    const middlebox &m_box = middleboxes[t_request.middlebox_sequence[0]];
-    if (IsResourceAvailable(t_request.source, node, current_vector[node], m_box,
-                            t_request)) {
-      cost[stage][node] = GetCost(t_request.source, node, current_vector[node],
-                                  m_box, t_request);
-      current_vector[node].cpu_cores[node] -= m_box.cpu_requirement;
-      DEBUG("[First stage] cost[stage][node] = %lf\n", cost[stage][node]);
+  // States of one stage are independent of each other, so each stage is
+  // relaxed in parallel over disjoint ranges of nodes. Every state is still
+  // computed by one thread in the serial order, so cost and pre do not depend
+  // on the number of threads.
+  ThreadPool &pool = GetThreadPool();
+  // The parts of the transition costs that only depend on the current node
+  // are computed once per stage, before the stage is relaxed.
+  static stage_costs costs;
+  const middlebox &first_m_box = middleboxes[t_request.middlebox_sequence[0]];
+  ComputeStageCosts(first_m_box, t_request, costs);
+  table.InitRow(0);
+  double *first_cost = table.CostRow(0);
+  pool.ParallelFor(0, kNumNodes, [&](int node_begin, int node_end) {
+    for (int node = node_begin; node < node_end; ++node) {
+      double cost = GetTransitionCost(t_request.source, node,
+                                      current_vector[node], first_m_box,
+                                      t_request, costs);
+      if (cost < std::numeric_limits<double>::infinity()) {
+        first_cost[node] = cost;
+        ConsumeCores(node, first_m_box.cpu_requirement, current_vector[node]);
+        DEBUG("[First stage] cost[stage][node] = %lf\n", first_cost[node]);
+      }
     }
-  }
+  });
+  std::vector<int> reachable;
+  std::vector<double> reachable_cost;
   for (stage = 1; stage < kNumStages; ++stage) {
     const middlebox &m_box = middleboxes[t_request.middlebox_sequence[stage]];
-    previous_vector = current_vector;
+    previous_vector.swap(current_vector);
+    ComputeStageCosts(m_box, t_request, costs);
+    table.InitRow(stage);
     DEBUG("[stage = %d] Placing middlebox = %s\n", stage,
           m_box.middlebox_name.c_str());
-    for (int current_node = 0; current_node < kNumNodes; ++current_node) {
-      int min_index = NIL;
+    if (viterbi_kernel == "minplus") {
+      reachable.clear();
+      reachable_cost.clear();
+      const double *prev_cost = table.CostRow(stage - 1);
       for (int prev_node = 0; prev_node < kNumNodes; ++prev_node) {
-        if (IsResourceAvailable(prev_node, current_node,
-                                previous_vector[prev_node], m_box, t_request)) {
-          double transition_cost =
-              cost[stage - 1][prev_node] + GetCost(prev_node, current_node,
-                                                   previous_vector[prev_node],
-                                                   m_box, t_request);
-          DEBUG(
-              "[stage = %d, middlebox = %s, prev_node = %d, tr_cost = "
-              "%lf]\n",
-              stage, m_box.middlebox_name.c_str(), prev_node, transition_cost);
-          if (cost[stage][current_node] > transition_cost) {
-            cost[stage][current_node] = transition_cost;
-            pre[stage][current_node] = prev_node;
-            min_index = prev_node;
-          }
+        if (prev_cost[prev_node] < INF) {
+          reachable.push_back(prev_node);
+          reachable_cost.push_back(prev_cost[prev_node]);
         }
       }
-      DEBUG("[stage = %d, min_index = %d]\n", stage, min_index);
-      if (min_index != NIL) {
-        DEBUG("Current node = %d, min_index = %d\n", current_node, min_index);
-        current_vector[current_node].cpu_cores =
-            previous_vector[min_index].cpu_cores;
-        bool new_middlebox_deployed = true;
-        for (middlebox_instance &mbox_instance :
-             deployed_mboxes[current_node]) {
-          if (mbox_instance.m_box->middlebox_name == m_box.middlebox_name &&
-              mbox_instance.residual_capacity >= t_request.min_bandwidth) {
-            new_middlebox_deployed = false;
-            break;
-          }
-        }
-        if (new_middlebox_deployed) {
-          current_vector[current_node].cpu_cores[current_node] -=
-              m_box.cpu_requirement;
+      pool.ParallelFor(0, kNumNodes, [&](int node_begin, int node_end) {
+        ViterbiRelaxMinPlus(stage, node_begin, node_end, m_box, t_request,
+                            costs, reachable, reachable_cost, previous_vector,
+                            current_vector, table);
+      });
+    } else {
+      pool.ParallelFor(0, kNumNodes, [&](int node_begin, int node_end) {
+        for (int current_node = node_begin; current_node < node_end;
+             ++current_node) {
+          ViterbiRelax(stage, current_node, m_box, t_request, costs,
+                       previous_vector, current_vector, table);
         }
-      } else {
-        current_vector[current_node].cpu_cores.clear();
-      }
+      });
     }
   }
 
   // Find the solution sequence
   double min_cost = INF;
   int min_index = NIL;
+  const double *last_cost = table.CostRow(kNumStages - 1);
   for (int cur_node = 0; cur_node < kNumNodes; ++cur_node) {
     double transition_cost =
-        cost[kNumStages - 1][cur_node] +
+        last_cost[cur_node] +
         GetTransitCost(cur_node, t_request.destination, t_request) +
         GetSLAViolationCost(cur_node, t_request.destination, t_request,
                             fake_mbox);
@@ -112,7 +256,7 @@ std::unique_ptr<std::vector<int> > ViterbiCompute(
   int current_node = min_index;
   for (stage = kNumStages - 1; stage >= 0; --stage) {
     return_vector->push_back(current_node);
-    current_node = pre[stage][current_node];
+    current_node = table.PreRow(stage)[current_node];
   }
   DEBUG("Computed vector size = %d\n", return_vector->size());
   return_vector->push_back(t_request.source);